@@ -0,0 +1,85 @@
+/*
+	File Name: AudioRingBuffer.cpp
+
+	Brief: Defines AudioRingBuffer, a lock-free single producer/single consumer ring of bytes.
+	Used to hand converted audio from the audio decode thread to the audio device's callback.
+*/
+
+#include "AudioRingBuffer.hpp"
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer(int capacity, int alignment)
+{
+	if (alignment < 1) alignment = 1;
+	int size = ((capacity + alignment - 1) / alignment) * alignment;
+	buffer.resize((size > 0) ? size : alignment);
+}
+
+int AudioRingBuffer::Write(const Uint8* data, int length)
+{
+	int written = 0;
+	//At most two regions, before and after wrapping around.
+	for (int i = 0; i < 2 && written < length; i++)
+	{
+		Uint8* region = nullptr;
+		int regionLength = GetWriteRegion(&region);
+		if (regionLength == 0) break;
+		int toWrite = (length - written < regionLength) ? length - written : regionLength;
+		std::memcpy(region, data + written, toWrite);
+		CommitWrite(toWrite);
+		written += toWrite;
+	}
+	return written;
+}
+
+int AudioRingBuffer::GetWriteRegion(Uint8** region)
+{
+	uint64_t write = writeIndex.load(std::memory_order_relaxed);
+	//Acquire, so the consumer is done with the space before it is written to again.
+	uint64_t read = readIndex.load(std::memory_order_acquire);
+	uint64_t capacity = buffer.size();
+	uint64_t freeSpace = capacity - (write - read);
+	uint64_t start = write % capacity;
+	uint64_t untilWrap = capacity - start;
+	*region = buffer.data() + start;
+	return static_cast<int>((freeSpace < untilWrap) ? freeSpace : untilWrap);
+}
+
+void AudioRingBuffer::CommitWrite(int length)
+{
+	//Release, so the data is visible before the consumer sees the new index.
+	writeIndex.store(writeIndex.load(std::memory_order_relaxed) + length, std::memory_order_release);
+}
+
+int AudioRingBuffer::Read(Uint8* output, int length)
+{
+	uint64_t read = readIndex.load(std::memory_order_relaxed);
+	uint64_t write = writeIndex.load(std::memory_order_acquire);
+	uint64_t capacity = buffer.size();
+	uint64_t available = write - read;
+	uint64_t toRead = (static_cast<uint64_t>(length) < available) ? static_cast<uint64_t>(length) : available;
+	if (toRead == 0) return 0;
+
+	//May need to wrap around to the start of the buffer.
+	uint64_t start = read % capacity;
+	uint64_t firstPart = (toRead < capacity - start) ? toRead : capacity - start;
+	std::memcpy(output, buffer.data() + start, static_cast<size_t>(firstPart));
+	std::memcpy(output + firstPart, buffer.data(), static_cast<size_t>(toRead - firstPart));
+
+	readIndex.store(read + toRead, std::memory_order_release);
+	return static_cast<int>(toRead);
+}
+
+int AudioRingBuffer::Discard(int length)
+{
+	uint64_t read = readIndex.load(std::memory_order_relaxed);
+	uint64_t available = writeIndex.load(std::memory_order_acquire) - read;
+	uint64_t toDiscard = (static_cast<uint64_t>(length) < available) ? static_cast<uint64_t>(length) : available;
+	readIndex.store(read + toDiscard, std::memory_order_release);
+	return static_cast<int>(toDiscard);
+}
+
+int AudioRingBuffer::Available() const
+{
+	return static_cast<int>(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire));
+}
@@ -0,0 +1,63 @@
+/*
+	File Name: AudioRingBuffer.hpp
+
+	Brief: Declares AudioRingBuffer, a lock-free single producer/single consumer ring of bytes.
+	Used to hand converted audio from the audio decode thread to the audio device's callback.
+*/
+
+#ifndef AUDIORINGBUFFER_HPP
+#define AUDIORINGBUFFER_HPP
+#include "types.hpp"
+#include <vector>
+#include <atomic>
+
+/*
+	Exactly one thread may write (Write) and exactly one other thread may read (Read/Discard).
+	No locks are taken, so the audio callback is never blocked by the decode thread.
+*/
+class AudioRingBuffer
+{
+public:
+	/*
+		capacity --> Rounded up to a multiple of alignment.
+		alignment --> Size of a single sample frame(all channels). Reads and writes should be in multiples of this,
+		so that a sample frame is never split where the ring wraps around.
+	*/
+	AudioRingBuffer(int capacity, int alignment = 1);
+
+	AudioRingBuffer(const AudioRingBuffer& toCopy) = delete;
+	AudioRingBuffer& operator=(const AudioRingBuffer& rhs) = delete;
+
+	//=======Producer side
+	//Copies as much of data as there's space for. Returns the number of bytes written.
+	int Write(const Uint8* data, int length);
+	/*
+		For writing straight into the ring without an intermediate buffer.
+		Points region at the free space after the last write, and returns how many bytes can be written there without wrapping.
+		Nothing is visible to the consumer until CommitWrite is called.
+	*/
+	int GetWriteRegion(Uint8** region);
+	//Makes length bytes written into the region from GetWriteRegion visible to the consumer.
+	void CommitWrite(int length);
+
+	//=======Consumer side
+	//Copies up to length bytes into output. Returns the number of bytes read.
+	int Read(Uint8* output, int length);
+	//Throws away up to length bytes. Returns the number of bytes thrown away.
+	int Discard(int length);
+
+	//Bytes waiting to be read.
+	int Available() const;
+	//Bytes that can be written.
+	int FreeSpace() const { return Capacity() - Available(); }
+	int Capacity() const { return static_cast<int>(buffer.size()); }
+
+private:
+	std::vector<Uint8> buffer{};
+	//Both only ever increase(64 bits, so they never wrap around), the position in buffer is the index % capacity.
+	//writeIndex is only written by the producer, readIndex only by the consumer.
+	std::atomic<uint64_t> writeIndex{ 0 };
+	std::atomic<uint64_t> readIndex{ 0 };
+};
+
+#endif
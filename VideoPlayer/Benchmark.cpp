@@ -0,0 +1,360 @@
+/*
+	File Name: Benchmark.cpp
+
+	Brief: Defines benchmarks for the expensive stages of the video path, run with the --benchmark command line option.
+	Uses generated frames, so no video file or window is needed. Reverse playback needs real GOPs, so is run on given files instead.
+*/
+
+#include "Benchmark.hpp"
+#include "SliceScaler.hpp"
+#include "PixelConvert.hpp"
+#include "ReverseDecoder.hpp"
+#include "KeyframeIndex.hpp"
+#include "Utility.hpp"
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <chrono>
+
+namespace
+{
+	//Rows of that plane for a frame of the given height.
+	int PlaneHeight(const AVPixFmtDescriptor* desc, int plane, int height)
+	{
+		if (plane != 1 && plane != 2) return height;
+		return -((-height) >> desc->log2_chroma_h);
+	}
+
+	//Allocates a frame filled with a pattern, so the scaler has detail to filter. Returns nullptr if unable to.
+	AVFrame* CreatePatternFrame(int width, int height, AVPixelFormat format)
+	{
+		AVFrame* frame = av_frame_alloc();
+		if (!frame) return nullptr;
+		frame->format = format;
+		frame->width = width;
+		frame->height = height;
+		if (av_frame_get_buffer(frame, 64) < 0)
+		{
+			av_frame_free(&frame);
+			return nullptr;
+		}
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+		//Samples wider than 8 bits are kept within their bit depth, in the bits the format keeps them in.
+		int depth = desc->comp[0].depth;
+		int shift = desc->comp[0].shift;
+		for (int plane = 0; plane < 4 && frame->data[plane]; plane++)
+		{
+			int bytes = av_image_get_linesize(format, width, plane);
+			int rows = PlaneHeight(desc, plane, height);
+			for (int y = 0; y < rows; y++)
+			{
+				uint8_t* row = frame->data[plane] + y * frame->linesize[plane];
+				if (depth > 8)
+				{
+					uint16_t* samples = reinterpret_cast<uint16_t*>(row);
+					for (int x = 0; x < bytes / 2; x++)
+					{
+						int value = (x * 7 + y * 13 + ((x / 16 + y / 16) % 2) * 384 + plane * 124) & ((1 << depth) - 1);
+						samples[x] = static_cast<uint16_t>(value << shift);
+					}
+					continue;
+				}
+				for (int x = 0; x < bytes; x++)
+				{
+					row[x] = static_cast<uint8_t>((x * 7 + y * 13 + ((x / 16 + y / 16) % 2) * 96 + plane * 31) & 0xFF);
+				}
+			}
+		}
+		return frame;
+	}
+
+	//Largest difference between two frames of the same format and size.
+	int MaxDifference(const AVFrame* a, const AVFrame* b)
+	{
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(a->format));
+		int maxDifference = 0;
+		for (int plane = 0; plane < 4 && a->data[plane] && b->data[plane]; plane++)
+		{
+			int bytes = av_image_get_linesize(static_cast<AVPixelFormat>(a->format), a->width, plane);
+			int rows = PlaneHeight(desc, plane, a->height);
+			for (int y = 0; y < rows; y++)
+			{
+				const uint8_t* rowA = a->data[plane] + y * a->linesize[plane];
+				const uint8_t* rowB = b->data[plane] + y * b->linesize[plane];
+				for (int x = 0; x < bytes; x++)
+				{
+					int difference = std::abs(rowA[x] - rowB[x]);
+					if (difference > maxDifference) maxDifference = difference;
+				}
+			}
+		}
+		return maxDifference;
+	}
+
+	//Only the layout changes(e.g. NV12's interleaved chroma), so the output must be exactly swscale's.
+	//Otherwise PixelConvert averages chroma and drops low bits, where swscale filters and dithers.
+	bool IsSwscaleExact(AVPixelFormat srcFormat, AVPixelFormat dstFormat)
+	{
+		const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+		const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+		return srcDesc && dstDesc && srcDesc->log2_chroma_w == dstDesc->log2_chroma_w && srcDesc->log2_chroma_h == dstDesc->log2_chroma_h
+			&& srcDesc->comp[0].depth == dstDesc->comp[0].depth;
+	}
+}
+
+namespace Benchmark
+{
+	void RunScaling(std::ostream& output)
+	{
+		struct ScaleCase
+		{
+			const char* name;
+			int srcWidth, srcHeight, dstWidth, dstHeight;
+		};
+		const ScaleCase cases[] = {
+			{ "1080p", 1920, 1080, 1280, 720 },
+			{ "1440p", 2560, 1440, 1920, 1080 },
+			{ "2160p", 3840, 2160, 2560, 1440 },
+		};
+		const int threadCounts[] = { 1, 2, 4, 8 };
+		const int iterations = 30;
+
+		output << "<<Scaling Benchmark>> YUV420P, bicubic, " << iterations << " frames each\n";
+		for (const ScaleCase& scaleCase : cases)
+		{
+			AVFrame* src = CreatePatternFrame(scaleCase.srcWidth, scaleCase.srcHeight, AV_PIX_FMT_YUV420P);
+			AVFrame* reference = CreatePatternFrame(scaleCase.dstWidth, scaleCase.dstHeight, AV_PIX_FMT_YUV420P);
+			AVFrame* dst = CreatePatternFrame(scaleCase.dstWidth, scaleCase.dstHeight, AV_PIX_FMT_YUV420P);
+			if (!src || !reference || !dst)
+			{
+				output << "Unable to allocate frames for " << scaleCase.name << "\n";
+				av_frame_free(&src);
+				av_frame_free(&reference);
+				av_frame_free(&dst);
+				continue;
+			}
+
+			double singleThreadFps = 0;
+			for (int threadCount : threadCounts)
+			{
+				SliceScaler scaler{ threadCount };
+				if (!scaler.Configure(scaleCase.srcWidth, scaleCase.srcHeight, AV_PIX_FMT_YUV420P,
+					scaleCase.dstWidth, scaleCase.dstHeight, AV_PIX_FMT_YUV420P, SWS_BICUBIC))
+				{
+					output << scaleCase.name << ", " << threadCount << " threads: unable to configure scaler\n";
+					continue;
+				}
+				AVFrame* target = threadCount == 1 ? reference : dst;
+				//Warm up, so thread start and first touch of the buffers aren't timed.
+				scaler.Scale(src, target);
+
+				double start = Utility::GetTime();
+				for (int i = 0; i < iterations; i++)
+				{
+					scaler.Scale(src, target);
+				}
+				double elapsed = Utility::GetTime() - start;
+				double fps = elapsed > 0 ? iterations / elapsed : 0;
+				if (threadCount == 1) singleThreadFps = fps;
+
+				output << scaleCase.name << " -> " << scaleCase.dstWidth << "x" << scaleCase.dstHeight
+					<< ", " << threadCount << " threads(" << scaler.GetBandCount() << " bands): "
+					<< fps << " fps";
+				if (threadCount != 1)
+				{
+					output << ", " << (singleThreadFps > 0 ? fps / singleThreadFps : 0) << "x"
+						<< ", max difference from 1 thread " << MaxDifference(reference, dst);
+				}
+				output << "\n";
+			}
+			av_frame_free(&src);
+			av_frame_free(&reference);
+			av_frame_free(&dst);
+		}
+	}
+
+	bool RunConversion(std::ostream& output)
+	{
+		bool isPassed = true;
+		const int width = 1920, height = 1080;
+		const int iterations = 100;
+		PixelConvert::SimdLevel supportedLevel = PixelConvert::GetSupportedLevel();
+
+		output << "<<Conversion Benchmark>> " << width << "x" << height << ", " << iterations << " frames each"
+			<< ", CPU supports " << PixelConvert::GetSimdLevelName(supportedLevel) << "\n";
+		for (int index = 0; index < PixelConvert::GetConverterCount(); index++)
+		{
+			AVPixelFormat srcFormat, dstFormat;
+			if (!PixelConvert::GetConverterFormats(index, srcFormat, dstFormat)) continue;
+			std::string pairName = std::string{ av_get_pix_fmt_name(srcFormat) } + " -> " + av_get_pix_fmt_name(dstFormat);
+			AVFrame* src = CreatePatternFrame(width, height, srcFormat);
+			AVFrame* reference = av_frame_alloc();
+			AVFrame* dst = av_frame_alloc();
+			AVFrame* swscaleOutput = CreatePatternFrame(width, height, dstFormat);
+			if (!src || !reference || !dst || !swscaleOutput)
+			{
+				output << "Unable to allocate frames for " << pairName << ": FAIL\n";
+				isPassed = false;
+				av_frame_free(&src);
+				av_frame_free(&reference);
+				av_frame_free(&dst);
+				av_frame_free(&swscaleOutput);
+				continue;
+			}
+
+			//swscale's generic path is what the specialized converters replace.
+			double swscaleFps = 0;
+			SwsContext* context = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_POINT, NULL, NULL, NULL);
+			if (context)
+			{
+				sws_scale(context, src->data, src->linesize, 0, height, swscaleOutput->data, swscaleOutput->linesize);
+				double start = Utility::GetTime();
+				for (int i = 0; i < iterations; i++)
+				{
+					sws_scale(context, src->data, src->linesize, 0, height, swscaleOutput->data, swscaleOutput->linesize);
+				}
+				double elapsed = Utility::GetTime() - start;
+				swscaleFps = elapsed > 0 ? iterations / elapsed : 0;
+				output << pairName << ", swscale: " << swscaleFps << " fps\n";
+			}
+			sws_freeContext(context);
+
+			for (int level = 0; level <= static_cast<int>(supportedLevel); level++)
+			{
+				PixelConvert::SetLevel(static_cast<PixelConvert::SimdLevel>(level));
+				PixelConvert::Converter converter = PixelConvert::FindConverter(srcFormat, dstFormat);
+				AVFrame* target = level == 0 ? reference : dst;
+				//Warm up, so the first allocation of the output isn't timed.
+				if (!converter || !converter(src, target))
+				{
+					output << pairName << ": unable to convert, FAIL\n";
+					isPassed = false;
+					break;
+				}
+
+				double start = Utility::GetTime();
+				for (int i = 0; i < iterations; i++)
+				{
+					converter(src, target);
+				}
+				double elapsed = Utility::GetTime() - start;
+				double fps = elapsed > 0 ? iterations / elapsed : 0;
+
+				output << pairName << ", " << PixelConvert::GetSimdLevelName(static_cast<PixelConvert::SimdLevel>(level)) << ": " << fps << " fps"
+					<< ", " << (swscaleFps > 0 ? fps / swscaleFps : 0) << "x swscale";
+				if (level == 0)
+				{
+					int difference = context ? MaxDifference(reference, swscaleOutput) : -1;
+					if (context && IsSwscaleExact(srcFormat, dstFormat))
+					{
+						bool isExact = difference == 0;
+						output << (isExact ? ", bit exact with swscale" : ", FAIL: differs from swscale by up to ");
+						if (!isExact) output << difference;
+						isPassed = isPassed && isExact;
+					}
+					//swscale decimates chroma with its own filter and dithers when narrowing, so differences of a level or two are expected.
+					else if (context) output << ", max difference from swscale " << difference << "(not expected to be exact)";
+				}
+				else
+				{
+					bool isExact = MaxDifference(reference, dst) == 0;
+					output << (isExact ? ", bit exact with scalar" : ", FAIL: differs from scalar");
+					isPassed = isPassed && isExact;
+				}
+				output << "\n";
+			}
+			PixelConvert::SetLevel(supportedLevel);
+
+			av_frame_free(&src);
+			av_frame_free(&reference);
+			av_frame_free(&dst);
+			av_frame_free(&swscaleOutput);
+		}
+		output << "Conversion checks: " << (isPassed ? "PASS" : "FAIL") << "\n";
+		return isPassed;
+	}
+
+	bool RunAll(std::ostream& output)
+	{
+		RunScaling(output);
+		return RunConversion(output);
+	}
+
+	void RunReverse(const std::string& fileName, std::ostream& output)
+	{
+		AVFormatContext* container = nullptr;
+		if (avformat_open_input(&container, fileName.c_str(), NULL, NULL) != 0 || avformat_find_stream_info(container, NULL) < 0)
+		{
+			output << "Unable to open " << fileName << "\n";
+			if (container) avformat_close_input(&container);
+			return;
+		}
+		int streamIndex = av_find_best_stream(container, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+		if (streamIndex < 0)
+		{
+			output << "No video in " << fileName << "\n";
+			avformat_close_input(&container);
+			return;
+		}
+		const AVStream* stream = container->streams[streamIndex];
+		double duration = container->duration != AV_NOPTS_VALUE ? static_cast<double>(container->duration) / AV_TIME_BASE : 0;
+		//Starts a second before the end, so the first chunk is a whole one.
+		double from = duration > 1 ? duration - 1 : duration;
+		double to = from > reverseSeconds ? from - reverseSeconds : 0;
+
+		//Chunks line up with GOPs once the index is built, as when playing.
+		KeyframeIndex keyframeIndex{ fileName, streamIndex };
+		double indexStart = Utility::GetTime();
+		while (!keyframeIndex.IsComplete() && Utility::GetTime() - indexStart < 60)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		const char* formatName = av_get_pix_fmt_name(static_cast<AVPixelFormat>(stream->codecpar->format));
+		output << "<<Reverse Playback Benchmark>> " << fileName << ", " << stream->codecpar->width << "x" << stream->codecpar->height
+			<< " " << (formatName ? formatName : "unknown") << ", " << from << " to " << to << " secs\n";
+		AVFrame* frame = av_frame_alloc();
+		//0 is as fast as frames are decoded.
+		const double speeds[] = { 0, 1, 2, 4 };
+		for (double speed : speeds)
+		{
+			ReverseDecoder decoder{ fileName, stream, &keyframeIndex, from };
+			int shownCount = 0;
+			double lastPts = -1;
+			double start = Utility::GetTime();
+			double now = start;
+			//Position only moves on while frames are ready, as when playing.
+			double position = from, positionTime = start;
+			while (frame && position >= to && !decoder.IsAtStart() && !decoder.IsFailed())
+			{
+				now = Utility::GetTime();
+				double target = speed > 0 ? position - (now - positionTime) * speed : position;
+				double pts = 0, frameDuration = 0;
+				if (!decoder.GetFrame(target, frame, pts, frameDuration))
+				{
+					positionTime = now;
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				position = target;
+				positionTime = now;
+				if (pts != lastPts)
+				{
+					lastPts = pts;
+					shownCount++;
+				}
+				//Straight on to the frame before.
+				if (speed == 0) position = pts - 1e-6;
+				else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			double elapsed = now - start;
+			output << (speed == 0 ? std::string{ "Unpaced" } : std::to_string(static_cast<int>(speed)) + "x")
+				<< ": " << shownCount << " frames shown in " << elapsed << " secs"
+				<< ", " << (elapsed > 0 ? (from - position) / elapsed : 0) << "x realtime"
+				<< ", peak " << decoder.GetPeakBytes() / (1024 * 1024) << " MB held\n";
+			decoder.PrintStats(output);
+		}
+		av_frame_free(&frame);
+		avformat_close_input(&container);
+	}
+}
@@ -0,0 +1,42 @@
+/*
+	File Name: Benchmark.hpp
+
+	Brief: Declares benchmarks for the expensive stages of the video path, run with the --benchmark command line option.
+	Uses generated frames, so no video file or window is needed. Reverse playback needs real GOPs, so is run on given files instead.
+*/
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+#include <ostream>
+#include <string>
+
+namespace Benchmark
+{
+	/*
+		Times SliceScaler with 1/2/4/8 threads, scaling 1080p, 1440p and 2160p frames down a step.
+		Also checks the banded output matches scaling the whole frame at once.
+	*/
+	void RunScaling(std::ostream& output);
+
+	/*
+		Times each of PixelConvert's specialized converters at every SIMD level the CPU supports at 1080p,
+		against swscale's generic path for the same pair.
+		Checks every level's output is bit exact with the plain C kernels. Pairs that only change the layout(NV12/NV21) must also be
+		bit exact with swscale, the others only print how far off they are, as they average chroma and drop low bits instead.
+		Returns false if any check fails.
+	*/
+	bool RunConversion(std::ostream& output);
+
+	//Runs every benchmark. Returns false if any check fails.
+	bool RunAll(std::ostream& output);
+
+	/*
+		Plays the video file backwards from a second before its end, for up to reverseSeconds, with ReverseDecoder's default config.
+		Once as fast as frames are decoded, then at 1x, 2x and 4x. Prints frames shown, how much faster than realtime,
+		stalls and the memory held at most. Run with the --benchmark-reverse command line option, e.g. on a 1080p and a 4K file.
+	*/
+	void RunReverse(const std::string& fileName, std::ostream& output);
+	const double reverseSeconds = 10.0;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+	File Name: Clock.cpp
+
+	Brief: Defines the clocks used to keep audio and video in sync.
+	All times are in seconds, taken from a monotonic clock(Utility::GetTime) so they don't jump with system time adjustments.
+*/
+
+#include "Clock.hpp"
+#include "Utility.hpp"
+
+double Clock::Get() const
+{
+	return GetAt(Utility::GetTime());
+}
+
+double Clock::GetAt(double time) const
+{
+	if (isPaused || !isSet) return basePts;
+	return basePts + (time - baseTime);
+}
+
+void Clock::Set(double pts)
+{
+	SetAt(pts, Utility::GetTime());
+}
+
+void Clock::SetAt(double pts, double time)
+{
+	basePts = pts;
+	baseTime = time;
+	isSet = true;
+}
+
+void Clock::Sync(double pts, double time)
+{
+	double predicted = GetAt(time);
+	double difference = pts - predicted;
+	if (!isSet || difference > maxCorrection || difference < -maxCorrection)
+	{
+		SetAt(pts, time);
+		return;
+	}
+	SetAt(predicted + difference * smoothing, time);
+}
+
+void Clock::SetPaused(bool paused)
+{
+	if (paused == isPaused) return;
+	double now = Utility::GetTime();
+	//Keep the presentation time it stopped at, and count from now when unpaused.
+	basePts = GetAt(now);
+	baseTime = now;
+	isPaused = paused;
+}
+
+void ClockPublisher::Publish(double pts, double time, int serial)
+{
+	sequence.fetch_add(1); //Odd, reader will retry.
+	publishedPts = pts;
+	publishedTime = time;
+	publishedSerial = serial;
+	sequence.fetch_add(1); //Even, done.
+	isPublished = true;
+}
+
+bool ClockPublisher::Read(double& pts, double& time, int& serial) const
+{
+	if (!isPublished) return false;
+	unsigned int before, after;
+	do
+	{
+		before = sequence.load();
+		pts = publishedPts;
+		time = publishedTime;
+		serial = publishedSerial;
+		after = sequence.load();
+	} while ((before & 1) || before != after);
+	return true;
+}
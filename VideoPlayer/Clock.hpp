@@ -0,0 +1,80 @@
+/*
+	File Name: Clock.hpp
+
+	Brief: Declares the clocks used to keep audio and video in sync.
+	All times are in seconds, taken from a monotonic clock(Utility::GetTime) so they don't jump with system time adjustments.
+*/
+
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+#include <atomic>
+
+//Which clock the others are synced to.
+enum class ClockMaster
+{
+	AUDIO = 0, //Time of the audio actually coming out of the device.
+	VIDEO, //Time of the last video frame presented.
+	EXTERNAL, //Free running, only set when seeking.
+};
+
+/*
+	A presentation time that keeps running from the last time it was set.
+	Only used from a single thread, see ClockPublisher for passing times between threads.
+*/
+class Clock
+{
+public:
+	//Current presentation time.
+	double Get() const;
+	//Presentation time at the given time(from Utility::GetTime).
+	double GetAt(double time) const;
+
+	//Jumps straight to pts. Use for seeks and discontinuities.
+	void Set(double pts);
+	void SetAt(double pts, double time);
+
+	/*
+		Corrects the clock towards a new measurement of pts, taken at time.
+		Small differences are only partly applied each time, so that jitter in the measurements doesn't show.
+		Differences larger than maxCorrection jump straight to pts.
+	*/
+	void Sync(double pts, double time);
+
+	//Stops the clock where it is. Unpausing continues from the same presentation time.
+	void SetPaused(bool isPaused);
+	bool IsPaused() const { return isPaused; }
+
+	//Fraction of the difference applied each Sync.
+	static constexpr double smoothing = 0.1;
+	//Seconds of difference past which Sync jumps instead of correcting smoothly.
+	static constexpr double maxCorrection = 0.1;
+
+private:
+	double basePts = 0; //Presentation time at baseTime.
+	double baseTime = 0;
+	bool isSet = false;
+	bool isPaused = false;
+};
+
+/*
+	Lets one thread publish a presentation time for another to read, without locks.
+	The writer may be a real-time thread, like the audio callback.
+*/
+class ClockPublisher
+{
+public:
+	//Writer side. pts is the presentation time at time, serial is the seek serial it belongs to.
+	void Publish(double pts, double time, int serial);
+	//Reader side. Returns false if nothing was published yet.
+	bool Read(double& pts, double& time, int& serial) const;
+
+private:
+	//Odd while the writer is in the middle of publishing.
+	std::atomic<unsigned int> sequence{ 0 };
+	std::atomic<double> publishedPts{ 0 };
+	std::atomic<double> publishedTime{ 0 };
+	std::atomic<int> publishedSerial{ 0 };
+	std::atomic<bool> isPublished{ false };
+};
+
+#endif
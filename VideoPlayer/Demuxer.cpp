@@ -0,0 +1,560 @@
+/*
+	File Name: Demuxer.cpp
+
+	Brief: Defines the per-stream packet queue, and the Demuxer which reads packets from the video file on a background thread,
+	ahead of the decoders.
+*/
+
+#include "Demuxer.hpp"
+#include <iostream>
+#include <chrono>
+
+PacketQueue::PacketQueue(int initialCapacity, int maxCapacity, int64_t maxBytes)
+	: maxCapacity{ maxCapacity }, maxBytes{ maxBytes }
+{
+	//Packets are allocated up front, and reused for the lifetime of the queue.
+	for (int i = 0; i < initialCapacity; i++)
+	{
+		AVPacket* packet = av_packet_alloc();
+		if (!packet) break;
+		ring.push_back(packet);
+	}
+}
+
+PacketQueue::~PacketQueue()
+{
+	for (AVPacket*& packet : ring)
+	{
+		//Dereference buffer.
+		av_packet_unref(packet);
+		av_packet_free(&packet);
+	}
+	ring.clear();
+}
+
+bool PacketQueue::Grow()
+{
+	int oldCapacity = Capacity();
+	int newCapacity = (oldCapacity > 0) ? oldCapacity * 2 : 1;
+	if (newCapacity > maxCapacity) newCapacity = maxCapacity;
+	if (newCapacity <= oldCapacity) return false;
+
+	//Unwrap the ring so that the front packet is at index 0, then add the new blank packets after it.
+	std::vector<AVPacket*> newRing{};
+	newRing.reserve(newCapacity);
+	for (int i = 0; i < oldCapacity; i++)
+	{
+		newRing.push_back(ring[(head + i) % oldCapacity]);
+	}
+	for (int i = oldCapacity; i < newCapacity; i++)
+	{
+		AVPacket* packet = av_packet_alloc();
+		if (!packet) break;
+		newRing.push_back(packet);
+	}
+	ring.swap(newRing);
+	head = 0;
+	return Capacity() > oldCapacity;
+}
+
+bool PacketQueue::Push(AVPacket* packet)
+{
+	//Never makes space by dropping packets, a decoder would get a gap in its stream.
+	if (size == Capacity() && !Grow()) return false;
+	AVPacket* back = ring[(head + size) % Capacity()];
+	bytes += packet->size;
+	duration += packet->duration;
+	av_packet_move_ref(back, packet);
+	size++;
+	if (size > peakSize) peakSize = size;
+	if (IsFull()) fullCount++;
+	return true;
+}
+
+bool PacketQueue::Pop(AVPacket* packet)
+{
+	if (size == 0) return false;
+	AVPacket* front = ring[head];
+	bytes -= front->size;
+	duration -= front->duration;
+	av_packet_unref(packet);
+	av_packet_move_ref(packet, front);
+	head = (head + 1) % Capacity();
+	size--;
+	return true;
+}
+
+void PacketQueue::Clear()
+{
+	for (int i = 0; i < size; i++)
+	{
+		av_packet_unref(ring[(head + i) % Capacity()]);
+	}
+	head = 0;
+	size = 0;
+	bytes = 0;
+	duration = 0;
+}
+
+PacketBackBuffer::PacketBackBuffer(double maxSeconds, int64_t maxBytes)
+	: maxSeconds{ maxSeconds }, maxBytes{ maxBytes }
+{
+}
+
+PacketBackBuffer::~PacketBackBuffer()
+{
+	for (Entry& entry : ring)
+	{
+		av_packet_unref(entry.packet);
+		av_packet_free(&entry.packet);
+	}
+	ring.clear();
+}
+
+void PacketBackBuffer::Push(const AVPacket* packet, AVRational timeBase)
+{
+	if (maxSeconds <= 0 || maxBytes <= 0) return;
+	if (size == static_cast<int>(ring.size()))
+	{
+		//Unwrap the ring so that the oldest packet is at index 0, then add the new blank packets after it.
+		int oldCapacity = static_cast<int>(ring.size());
+		int newCapacity = oldCapacity > 0 ? oldCapacity * 2 : 256;
+		std::vector<Entry> newRing{};
+		newRing.reserve(newCapacity);
+		for (int i = 0; i < oldCapacity; i++)
+		{
+			newRing.push_back(ring[(head + i) % oldCapacity]);
+		}
+		for (int i = oldCapacity; i < newCapacity; i++)
+		{
+			Entry entry{};
+			entry.packet = av_packet_alloc();
+			if (!entry.packet) break;
+			newRing.push_back(entry);
+		}
+		ring.swap(newRing);
+		head = 0;
+		//Unable to allocate any more, so make space by dropping the oldest.
+		if (size == static_cast<int>(ring.size()))
+		{
+			if (size == 0) return;
+			PopFront();
+		}
+	}
+
+	Entry& entry = ring[(head + size) % ring.size()];
+	av_packet_unref(entry.packet);
+	if (av_packet_ref(entry.packet, packet) < 0) return;
+	int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+	entry.seconds = timestamp != AV_NOPTS_VALUE ? timestamp * av_q2d(timeBase) : newestSeconds;
+	entry.endSeconds = entry.seconds + packet->duration * av_q2d(timeBase);
+	if (size == 0 || entry.seconds > newestSeconds) newestSeconds = entry.seconds;
+	bytes += packet->size;
+	size++;
+	pushedCount++;
+
+	while (size > 0 && (bytes > maxBytes || Seconds() > maxSeconds)) PopFront();
+}
+
+int64_t PacketBackBuffer::FindKeyframe(int streamIndex, double seconds) const
+{
+	//Newest first, keyframes are read in presentation order.
+	int64_t keyframe = -1;
+	double streamEndSeconds = -1;
+	for (int64_t number = pushedCount - 1; number >= pushedCount - size; number--)
+	{
+		const Entry& entry = At(number);
+		if (entry.packet->stream_index != streamIndex) continue;
+		if (entry.endSeconds > streamEndSeconds) streamEndSeconds = entry.endSeconds;
+		if (keyframe < 0 && (entry.packet->flags & AV_PKT_FLAG_KEY) && entry.seconds <= seconds) keyframe = number;
+	}
+	//Past what's been read, so the container would have to read on from an old keyframe to get there.
+	if (seconds >= streamEndSeconds) return -1;
+	return keyframe;
+}
+
+const AVPacket* PacketBackBuffer::Get(int64_t number) const
+{
+	if (number < pushedCount - size || number >= pushedCount) return nullptr;
+	return At(number).packet;
+}
+
+double PacketBackBuffer::GetEndSeconds(int64_t number) const
+{
+	if (number < pushedCount - size || number >= pushedCount) return 0;
+	return At(number).endSeconds;
+}
+
+double PacketBackBuffer::Seconds() const
+{
+	if (size == 0) return 0;
+	return newestSeconds - ring[head].seconds;
+}
+
+void PacketBackBuffer::Clear()
+{
+	while (size > 0) PopFront();
+	head = 0;
+}
+
+void PacketBackBuffer::SetLimits(double newMaxSeconds, int64_t newMaxBytes)
+{
+	maxSeconds = newMaxSeconds;
+	maxBytes = newMaxBytes;
+}
+
+void PacketBackBuffer::PopFront()
+{
+	Entry& front = ring[head];
+	bytes -= front.packet->size;
+	av_packet_unref(front.packet);
+	head = (head + 1) % ring.size();
+	size--;
+}
+
+
+Demuxer::Demuxer(AVFormatContext* container, const std::vector<int>& streamIndexes, const DemuxConfig& config)
+	: container{ container }, config{ config }, backBuffer{ config.backBufferSeconds, config.backBufferBytes }
+{
+	packetQueues.resize(container ? container->nb_streams : 0);
+	for (int index : streamIndexes)
+	{
+		if (index < 0 || index >= static_cast<int>(packetQueues.size())) continue;
+		//A single queue never holds more than every queue together may.
+		packetQueues[index] = std::make_unique<PacketQueue>(64, 4096, config.hardLimitBytes);
+		//Video keyframes are where decoding can start again, any packet of the other streams usually is.
+		if (anchorStreamIndex < 0 || (container->streams[index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+			&& container->streams[anchorStreamIndex]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO))
+		{
+			anchorStreamIndex = index;
+		}
+	}
+	readPacket = av_packet_alloc();
+}
+
+Demuxer::~Demuxer()
+{
+	Stop();
+	//Queues hold packet references into the container, so they are cleared while it's still open.
+	packetQueues.clear();
+	backBuffer.Clear();
+	if (readPacket) av_packet_free(&readPacket);
+}
+
+void Demuxer::Start()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	if (isRunning || !container || !readPacket) return;
+	isRunning = true;
+	isStopRequested = false;
+	demuxThread = std::thread{ &Demuxer::Run, this };
+}
+
+void Demuxer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!isRunning) return;
+		isStopRequested = true;
+	}
+	stateChanged.notify_all();
+	if (demuxThread.joinable()) demuxThread.join();
+	std::lock_guard<std::mutex> lock{ mutex };
+	isRunning = false;
+	//Wake up anything still waiting on a packet.
+	packetAvailable.notify_all();
+}
+
+bool Demuxer::PopPacket(int streamIndex, AVPacket* packet, int* packetSerial, int timeoutMs)
+{
+	if (streamIndex < 0 || streamIndex >= static_cast<int>(packetQueues.size()) || !packetQueues[streamIndex]) return false;
+	PacketQueue& queue = *packetQueues[streamIndex];
+
+	std::unique_lock<std::mutex> lock{ mutex };
+	packetAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+		return queue.Size() > 0 || (isEOF && !isSeekRequested) || !isRunning;
+	});
+	if (!queue.Pop(packet)) return false;
+	if (packetSerial) *packetSerial = serial;
+	//Space was freed, demux thread may be waiting for the low watermark.
+	stateChanged.notify_all();
+	return true;
+}
+
+int Demuxer::RequestSeek(int64_t timestamp, int flags, int streamIndex, double targetSeconds)
+{
+	int seekSerial = 0;
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!isSeekRequested) requestedSerial++;
+		seekSerial = requestedSerial;
+		isSeekRequested = true;
+		seekTimestamp = timestamp;
+		seekFlags = flags;
+		seekStreamIndex = streamIndex;
+		seekTargetSeconds = targetSeconds;
+		//Queued packets are from the old position, so drop them now rather than at the seek.
+		//Decoders run dry straight away, instead of decoding towards a target that's been replaced.
+		for (std::unique_ptr<PacketQueue>& queue : packetQueues)
+		{
+			if (queue) queue->Clear();
+		}
+	}
+	stateChanged.notify_all();
+	return seekSerial;
+}
+
+double Demuxer::GetSeekTarget(int packetSerial)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return packetSerial == serial ? seekedTargetSeconds : -1;
+}
+
+bool Demuxer::IsFinished(int streamIndex)
+{
+	if (streamIndex < 0 || streamIndex >= static_cast<int>(packetQueues.size()) || !packetQueues[streamIndex]) return false;
+	std::lock_guard<std::mutex> lock{ mutex };
+	return isEOF && !isSeekRequested && packetQueues[streamIndex]->Size() == 0;
+}
+
+bool Demuxer::WaitForSeek(int packetSerial, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock{ mutex };
+	//Every seek done notifies packetAvailable, as does stopping.
+	return packetAvailable.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+		return serial != packetSerial || !isRunning;
+	}) && serial != packetSerial;
+}
+
+void Demuxer::SetConfig(const DemuxConfig& newConfig)
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		config = newConfig;
+		backBuffer.SetLimits(config.backBufferSeconds, config.backBufferBytes);
+		for (std::unique_ptr<PacketQueue>& queue : packetQueues)
+		{
+			if (queue) queue->SetMaxBytes(config.hardLimitBytes);
+		}
+	}
+	stateChanged.notify_all();
+}
+
+void Demuxer::PrintStats(std::ostream& output)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	output << "<<Packet Queues>>\n"
+		<< "Queued: " << QueuedBytes() << " bytes, " << QueuedSeconds() << " secs\n";
+	for (int i = 0; i < static_cast<int>(packetQueues.size()); i++)
+	{
+		if (!packetQueues[i]) continue;
+		const PacketQueue& queue = *packetQueues[i];
+		output << "Stream " << i << ": depth " << queue.Size() << "/" << queue.Capacity()
+			<< ", bytes " << queue.Bytes()
+			<< ", peak depth " << queue.PeakSize()
+			<< ", full " << queue.FullCount() << " times\n";
+	}
+	output << "Back buffer: " << backBuffer.Size() << " packets, " << backBuffer.Bytes() << " bytes, " << backBuffer.Seconds() << " secs"
+		<< ", seeks replayed from it " << replayedSeekCount << "/" << seekCount << "\n";
+}
+
+void Demuxer::Run()
+{
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (!isStopRequested)
+	{
+		if (isSeekRequested)
+		{
+			DoSeek(lock);
+			continue;
+		}
+
+		//A decoder waiting on an empty queue still gets packets, otherwise a full queue for the other stream would deadlock both.
+		bool isStarving = IsAnyQueueEmpty() && QueuedBytes() < config.hardLimitBytes;
+		if (isFull)
+		{
+			if (isStarving || (QueuedBytes() < config.lowWaterBytes && QueuedSeconds() < config.lowWaterSeconds)) isFull = false;
+		}
+		else if (!isStarving && (QueuedBytes() >= config.highWaterBytes || QueuedSeconds() >= config.highWaterSeconds))
+		{
+			isFull = true;
+		}
+
+		//Nothing to do until a packet is taken or a seek is requested.
+		//A queue that's full stops reading whatever the watermarks say, as the next packet may be for it.
+		if (isFull || isEOF || IsAnyQueueFull())
+		{
+			stateChanged.wait(lock);
+			continue;
+		}
+
+		//Packets after the container's read position only come from the container.
+		if (IsReplaying()) ReplayPacket();
+		else if (!ReadPacket(lock))
+		{
+			isEOF = true;
+			packetAvailable.notify_all();
+		}
+	}
+}
+
+bool Demuxer::ReadPacket(std::unique_lock<std::mutex>& lock)
+{
+	//Only the demux thread touches the container, so file I/O is done without holding the lock.
+	lock.unlock();
+	int errVal = av_read_frame(container, readPacket);
+	lock.lock();
+	if (errVal == AVERROR(EAGAIN)) return true;
+	if (errVal < 0) return false;
+
+	int streamIndex = readPacket->stream_index;
+	bool isKept = streamIndex >= 0 && streamIndex < static_cast<int>(packetQueues.size()) && packetQueues[streamIndex];
+	//Kept even if a seek is pending, as the back buffer has to run up to the read position without gaps.
+	if (isKept)
+	{
+		backBuffer.Push(readPacket, container->streams[streamIndex]->time_base);
+		replayPosition = backBuffer.End();
+	}
+	//Packets read before a pending seek would just be flushed, so don't bother queueing them.
+	if (!isSeekRequested && isKept)
+	{
+		packetQueues[streamIndex]->Push(readPacket);
+		packetAvailable.notify_all();
+	}
+	av_packet_unref(readPacket);
+	return true;
+}
+
+void Demuxer::DoSeek(std::unique_lock<std::mutex>& lock)
+{
+	int64_t timestamp = seekTimestamp;
+	int flags = seekFlags;
+	int streamIndex = seekStreamIndex;
+	double targetSeconds = seekTargetSeconds;
+	isSeekRequested = false;
+	seekCount++;
+
+	//Already read, so queue it again from memory. The container stays where it is, and reading carries on from there once replayed.
+	if (targetSeconds >= 0 && StartReplay(targetSeconds))
+	{
+		for (std::unique_ptr<PacketQueue>& queue : packetQueues)
+		{
+			if (queue) queue->Clear();
+		}
+		isEOF = false;
+		isFull = false;
+		seekedTargetSeconds = targetSeconds;
+		serial++;
+		replayedSeekCount++;
+		packetAvailable.notify_all();
+		return;
+	}
+
+	lock.unlock();
+	//A single seek repositions every stream, whichever stream the timestamp is for.
+	int errVal = av_seek_frame(container, streamIndex, timestamp, flags);
+	lock.lock();
+	if (errVal < 0)
+	{
+		//Container is still where it was, so carry on reading from there. Packets queued when it was requested are already gone.
+		std::cout << "Unable to seek to " << (targetSeconds >= 0 ? targetSeconds : static_cast<double>(timestamp) / AV_TIME_BASE) << " secs\n";
+		//Still a new serial, so anything waiting for the seek's packets gets them, and decoders flush across the gap.
+		seekedTargetSeconds = -1;
+		serial++;
+		packetAvailable.notify_all();
+		return;
+	}
+
+	//Start anew at the new position.
+	for (std::unique_ptr<PacketQueue>& queue : packetQueues)
+	{
+		if (queue) queue->Clear();
+	}
+	isEOF = false;
+	isFull = false;
+	seekedTargetSeconds = targetSeconds;
+	serial++;
+	//Packets behind the new read position would no longer run up to it.
+	backBuffer.Clear();
+	replayPosition = backBuffer.End();
+	packetAvailable.notify_all();
+}
+
+bool Demuxer::StartReplay(double targetSeconds)
+{
+	if (anchorStreamIndex < 0) return false;
+	int64_t keyframe = backBuffer.FindKeyframe(anchorStreamIndex, targetSeconds);
+	if (keyframe < 0) return false;
+	//Other streams' packets read just before the keyframe can still reach the target(e.g. audio interleaved a little early).
+	int64_t start = keyframe;
+	for (int64_t number = backBuffer.End() - backBuffer.Size(); number < keyframe; number++)
+	{
+		if (backBuffer.Get(number)->stream_index != anchorStreamIndex && backBuffer.GetEndSeconds(number) > targetSeconds)
+		{
+			start = number;
+			break;
+		}
+	}
+	replayPosition = start;
+	replayKeyframe = keyframe;
+	replayTargetSeconds = targetSeconds;
+	return true;
+}
+
+void Demuxer::ReplayPacket()
+{
+	while (IsReplaying())
+	{
+		int64_t number = replayPosition++;
+		const AVPacket* packet = backBuffer.Get(number);
+		if (!packet) continue;
+		//Before the keyframe, only the other streams' packets that reach the target.
+		if (number < replayKeyframe && (packet->stream_index == anchorStreamIndex || backBuffer.GetEndSeconds(number) <= replayTargetSeconds)) continue;
+		//The back buffer keeps its own reference, so it can be replayed again.
+		if (av_packet_ref(readPacket, packet) < 0) continue;
+		packetQueues[packet->stream_index]->Push(readPacket);
+		av_packet_unref(readPacket);
+		packetAvailable.notify_all();
+		return;
+	}
+}
+
+int64_t Demuxer::QueuedBytes() const
+{
+	int64_t total = 0;
+	for (const std::unique_ptr<PacketQueue>& queue : packetQueues)
+	{
+		if (queue) total += queue->Bytes();
+	}
+	return total;
+}
+
+double Demuxer::QueuedSeconds() const
+{
+	double shortest = -1;
+	for (int i = 0; i < static_cast<int>(packetQueues.size()); i++)
+	{
+		if (!packetQueues[i]) continue;
+		double seconds = packetQueues[i]->Duration() * av_q2d(container->streams[i]->time_base);
+		if (shortest < 0 || seconds < shortest) shortest = seconds;
+	}
+	return (shortest < 0) ? 0 : shortest;
+}
+
+bool Demuxer::IsAnyQueueEmpty() const
+{
+	for (const std::unique_ptr<PacketQueue>& queue : packetQueues)
+	{
+		if (queue && queue->Size() == 0) return true;
+	}
+	return false;
+}
+
+bool Demuxer::IsAnyQueueFull() const
+{
+	for (const std::unique_ptr<PacketQueue>& queue : packetQueues)
+	{
+		if (queue && queue->IsFull()) return true;
+	}
+	return false;
+}
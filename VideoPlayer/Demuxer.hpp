@@ -0,0 +1,279 @@
+/*
+	File Name: Demuxer.hpp
+
+	Brief: Declares the per-stream packet queue, and the Demuxer which reads packets from the video file on a background thread,
+	ahead of the decoders.
+*/
+
+#ifndef DEMUXER_HPP
+#define DEMUXER_HPP
+#include "types.hpp"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <ostream>
+
+// Packet queue for a single stream.
+// Bounded FIFO ring buffer, packets are moved in and out (av_packet_move_ref) so the AVPackets in the ring are allocated once and reused.
+// Starts small and doubles when full, up to maxCapacity. Nothing is ever dropped, the demuxer stops reading while the queue IsFull instead.
+class PacketQueue
+{
+public:
+	//maxBytes --> Packet data the queue holds before it counts as full, however few packets that is.
+	PacketQueue(int initialCapacity = 64, int maxCapacity = 4096, int64_t maxBytes = 64 * 1024 * 1024);
+	~PacketQueue();
+
+	PacketQueue(const PacketQueue& toCopy) = delete;
+	PacketQueue& operator=(const PacketQueue& rhs) = delete;
+
+	/*
+		Moves the packet's data into the back of the queue, leaving packet blank.
+		Returns false if the queue is at maxCapacity, or unable to allocate space for it. Check IsFull before reading the packet.
+	*/
+	bool Push(AVPacket* packet);
+
+	/*
+		Moves the packet at the front of the queue into packet.
+		Returns false if the queue is empty.
+	*/
+	bool Pop(AVPacket* packet);
+
+	//Unrefs all packets in the queue. Counters other than size are kept.
+	void Clear();
+
+	//Total duration of the packets in the queue, in the stream's time_base.
+	int64_t Duration() const { return duration; }
+	//At maxCapacity packets or maxBytes, so nothing more should be read until a packet is popped.
+	bool IsFull() const { return size >= maxCapacity || bytes >= maxBytes; }
+	void SetMaxBytes(int64_t newMaxBytes) { maxBytes = newMaxBytes; }
+
+	//=======Queue-depth counters
+	int Size() const { return size; }
+	int Capacity() const { return static_cast<int>(ring.size()); }
+	//Total size of the packets' data currently in the queue.
+	int64_t Bytes() const { return bytes; }
+	//Highest number of packets the queue has held at once.
+	int PeakSize() const { return peakSize; }
+	//Number of pushes that left the queue full, each stopping reading until a packet was popped.
+	int64_t FullCount() const { return fullCount; }
+
+private:
+	//Doubles the ring's capacity(up to maxCapacity), keeping packets in order. Returns false if it can't grow.
+	bool Grow();
+
+	std::vector<AVPacket*> ring{}; //Need to alloc and dealloc each packet.
+	int head = 0; //Index of the front packet.
+	int size = 0;
+	int maxCapacity;
+	int64_t maxBytes;
+
+	int64_t bytes = 0;
+	int64_t duration = 0;
+	int peakSize = 0;
+	int64_t fullCount = 0;
+};
+
+/*
+	The packets most recently read from the container, in the order they were read(all streams interleaved).
+	Holds references, so packets still queued for the decoders aren't copied.
+	Ring of AVPackets allocated once and reused, like PacketQueue. Oldest packets are dropped past the seconds/bytes limits.
+	Every packet is numbered in the order it was pushed, and keeps its number, so positions stay valid as older packets are dropped.
+*/
+class PacketBackBuffer
+{
+public:
+	PacketBackBuffer(double maxSeconds, int64_t maxBytes);
+	~PacketBackBuffer();
+
+	PacketBackBuffer(const PacketBackBuffer& toCopy) = delete;
+	PacketBackBuffer& operator=(const PacketBackBuffer& rhs) = delete;
+
+	/*
+		References packet at the back, then drops the oldest packets until back within the limits.
+		timeBase --> Of the packet's stream. Packets without timestamps are taken to be at the newest time pushed.
+	*/
+	void Push(const AVPacket* packet, AVRational timeBase);
+
+	/*
+		Number of the last keyframe of streamIndex starting at or before seconds.
+		Returns -1 if there's none, or seconds is past the end of that stream's packets.
+	*/
+	int64_t FindKeyframe(int streamIndex, double seconds) const;
+	//Packet with that number, null if it's been dropped or not pushed yet.
+	const AVPacket* Get(int64_t number) const;
+	double GetEndSeconds(int64_t number) const;
+
+	//Number the next packet pushed will get.
+	int64_t End() const { return pushedCount; }
+	int Size() const { return size; }
+	int64_t Bytes() const { return bytes; }
+	//Time between the oldest packet and the newest.
+	double Seconds() const;
+
+	//Unrefs every packet. Numbering carries on.
+	void Clear();
+	//Applied on the next Push.
+	void SetLimits(double newMaxSeconds, int64_t newMaxBytes);
+
+private:
+	struct Entry
+	{
+		AVPacket* packet = nullptr;
+		double seconds = 0, endSeconds = 0;
+	};
+	const Entry& At(int64_t number) const { return ring[(head + static_cast<int>(number - (pushedCount - size))) % ring.size()]; }
+	void PopFront();
+
+	std::vector<Entry> ring{};
+	int head = 0;
+	int size = 0;
+	int64_t pushedCount = 0;
+	int64_t bytes = 0;
+	//Latest presentation time pushed, as packets aren't read in presentation order.
+	double newestSeconds = 0;
+	double maxSeconds;
+	int64_t maxBytes;
+};
+
+/*
+	How far ahead of the decoders the demux thread reads.
+	Reading pauses once either high watermark is reached, and resumes once both are back under their low watermarks.
+	Durations are the shortest among the queued streams, so one stream can't starve the other.
+*/
+struct DemuxConfig
+{
+	int64_t highWaterBytes = 32 * 1024 * 1024;
+	int64_t lowWaterBytes = 16 * 1024 * 1024;
+	double highWaterSeconds = 10.0;
+	double lowWaterSeconds = 5.0;
+	//Watermarks are ignored while a decoder's queue is empty, but reading always stops past this.
+	int64_t hardLimitBytes = 128 * 1024 * 1024;
+	//Packets read are kept this long(and at most this many bytes, counting the ones still queued), so seeking back into them
+	//replays them from memory instead of reading the file again. 0 seconds disables it.
+	double backBufferSeconds = 30.0;
+	int64_t backBufferBytes = 64 * 1024 * 1024;
+};
+
+/*
+	Owns reading from the AVFormatContext once started, no other thread should touch the container until it is stopped.
+	Each packet read is sent straight to its stream's PacketQueue, packets for streams without a queue are thrown away.
+
+	Seeking is done on the demux thread as well. Every seek flushes the queues and increments the serial,
+	so decoders can tell when to flush their own buffers.
+	Seeks to a time still in the back buffer don't touch the container, the packets from the keyframe before it are queued again instead.
+*/
+class Demuxer
+{
+public:
+	/*
+		container --> Must outlive the Demuxer.
+		streamIndexes --> Streams to keep packets for.
+	*/
+	Demuxer(AVFormatContext* container, const std::vector<int>& streamIndexes, const DemuxConfig& config = DemuxConfig{});
+	~Demuxer();
+
+	Demuxer(const Demuxer& toCopy) = delete;
+	Demuxer& operator=(const Demuxer& rhs) = delete;
+
+	//Starts the demux thread.
+	void Start();
+	//Stops and joins the demux thread. Queued packets are kept.
+	void Stop();
+
+	/*
+		Moves the next packet for that stream into packet.
+		Waits up to timeoutMs for one to arrive, returns false if none did (or the file has ended, see IsFinished).
+		serial --> Set to the seek serial the packet was read under.
+	*/
+	bool PopPacket(int streamIndex, AVPacket* packet, int* serial, int timeoutMs);
+
+	/*
+		Asks the demux thread to seek, replacing any seek that hasn't been done yet. Queued packets are dropped straight away.
+		timestamp --> In AV_TIME_BASE if streamIndex is -1, else in that stream's time base. A byte position with AVSEEK_FLAG_BYTE.
+		flags --> AVSEEK_FLAG_*, passed to av_seek_frame.
+		targetSeconds --> Time actually wanted, decoders throw away what comes before it. -1 for none.
+		Returns the serial the packets after the seek will have. Every seek done increments the serial, even if it fails.
+	*/
+	int RequestSeek(int64_t timestamp, int flags, int streamIndex = -1, double targetSeconds = -1);
+
+	//Seek serial of the packets currently being queued.
+	int GetSerial() const { return serial; }
+	//targetSeconds of the seek that started that serial, -1 if it had none or that serial is no longer current.
+	double GetSeekTarget(int serial);
+
+	//True when the end of the file is reached, no seek is pending and that stream's queue has been emptied.
+	bool IsFinished(int streamIndex);
+	//Waits up to timeoutMs for a seek to give packets a serial other than this one. Returns true if one did.
+	bool WaitForSeek(int serial, int timeoutMs);
+
+	void SetConfig(const DemuxConfig& newConfig);
+
+	//Prints depth, peak depth and how often each stream's packet queue was full.
+	void PrintStats(std::ostream& output);
+
+private:
+	//Demux thread's loop.
+	void Run();
+	//Reads a single packet and queues it. Returns false on EOF/error. Requires lock on mutex.
+	bool ReadPacket(std::unique_lock<std::mutex>& lock);
+	//Does the pending seek. Requires lock on mutex.
+	void DoSeek(std::unique_lock<std::mutex>& lock);
+	//Starts replaying the back buffer for the pending seek, if it holds the target. Requires lock on mutex.
+	bool StartReplay(double targetSeconds);
+	//Queues the next packet being replayed. Requires lock on mutex.
+	void ReplayPacket();
+	bool IsReplaying() const { return replayPosition < backBuffer.End(); }
+
+	//Watermark checks. Require lock on mutex.
+	int64_t QueuedBytes() const;
+	double QueuedSeconds() const;
+	bool IsAnyQueueEmpty() const;
+	bool IsAnyQueueFull() const;
+
+	AVFormatContext* container;
+	//Packet queue for each stream, indexed by stream_index. Null if the stream isn't kept.
+	std::vector<std::unique_ptr<PacketQueue>> packetQueues{};
+	//Packet read from the container before it is moved into a stream's queue. Need to alloc and dealloc.
+	AVPacket* readPacket = nullptr;
+	DemuxConfig config;
+	//Stream whose keyframes replays start from, the first kept video stream if there is one.
+	int anchorStreamIndex = -1;
+	//Packets up to the container's read position, only those of kept streams. Cleared whenever the container seeks.
+	PacketBackBuffer backBuffer;
+	//Number of the next back buffer packet to queue again. At the back buffer's end when not replaying.
+	int64_t replayPosition = 0;
+	//Keyframe a replay starts decoding from. Packets before it are only queued for the other streams, if they reach the target.
+	int64_t replayKeyframe = 0;
+	double replayTargetSeconds = 0;
+	int seekCount = 0, replayedSeekCount = 0;
+
+	std::thread demuxThread{};
+	//Guards everything below, as well as the queues.
+	std::mutex mutex{};
+	//Signalled when a packet is queued, or when the file ends.
+	std::condition_variable packetAvailable{};
+	//Signalled when a packet is taken, a seek is requested or the thread is told to stop.
+	std::condition_variable stateChanged{};
+
+	bool isRunning = false;
+	bool isStopRequested = false;
+	bool isEOF = false;
+	//Set while paused at the high watermark, cleared at the low watermark.
+	bool isFull = false;
+
+	bool isSeekRequested = false;
+	int64_t seekTimestamp = 0;
+	int seekFlags = 0;
+	int seekStreamIndex = -1;
+	double seekTargetSeconds = -1;
+	//targetSeconds of the last seek done, for the current serial.
+	double seekedTargetSeconds = -1;
+	std::atomic<int> serial{ 0 };
+	//Serial the latest seek requested will give. A pending seek that's replaced gives its serial to the one replacing it.
+	int requestedSerial = 0;
+};
+
+#endif
@@ -76,8 +76,15 @@ SDL_Window* DisplayWindow::mainWindow;
 SDL_Renderer* DisplayWindow::mainWindow_renderer;
 int DisplayWindow::window_dimensions[2];
 SDL_DisplayMode DisplayWindow::device_dimensions;
-SDL_Texture* DisplayWindow::videoDisplayTexture;
+VideoTexture DisplayWindow::videoDisplayTexture;
+VideoTexture DisplayWindow::lockTextures[2];
+int DisplayWindow::lockTextureIndex;
+SDL_Texture* DisplayWindow::presentedTexture;
+AVFrame* DisplayWindow::lockedTextureFrame;
+UploadMode DisplayWindow::uploadMode = UploadMode::UPDATE;
+SDL_RendererInfo DisplayWindow::renderer_info;
 SDL_Rect DisplayWindow::videoDisplayRect;
+SDL_Rect DisplayWindow::videoDimensions;
 
 
 bool DisplayWindow::Initialize()
@@ -111,24 +118,40 @@ bool DisplayWindow::Initialize()
 		return false;
 	}
 
-	//Video display texture for now will be same as program window.
-	videoDisplayTexture = SDL_CreateTexture(mainWindow_renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, window_dimensions[0], window_dimensions[1]);
-	if (!videoDisplayTexture)
+	if (SDL_GetRendererInfo(mainWindow_renderer, &renderer_info) != 0)
 	{
-		SDL_Log("Failed to init main window's texture");
+		SDL_Log("Failed to get renderer info");
+		return false;
+	}
+	//Video textures are scaled by the renderer, so use linear filtering rather than nearest pixel.
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+	//Video display textures are created when the first frame is drawn, to match the frame's size and format.
+	presentedTexture = nullptr;
+	lockTextureIndex = 0;
+	lockedTextureFrame = av_frame_alloc();
+	if (!lockedTextureFrame)
+	{
+		SDL_Log("Failed to allocate frame for locked textures");
 		return false;
 	}
 	//The actual dimensions the video can display in, for now is set to window_dimensions.
-	videoDisplayRect = { 0, 0, window_dimensions[0], window_dimensions[1] };
+	videoDimensions = SDL_Rect{};
+	FitVideoDisplayRect();
 	return true;
 }
 
 
 void DisplayWindow::Free()
 {
+	//Textures belong to the renderer, so they go first.
+	FreeVideoTexture(videoDisplayTexture);
+	FreeVideoTexture(lockTextures[0]);
+	FreeVideoTexture(lockTextures[1]);
+	presentedTexture = nullptr;
+	av_frame_free(&lockedTextureFrame);
 	if (mainWindow_renderer) SDL_DestroyRenderer(mainWindow_renderer);
 	if (mainWindow) SDL_DestroyWindow(mainWindow);
-	if (videoDisplayTexture) SDL_DestroyTexture(videoDisplayTexture);
 }
 
 void DisplayWindow::DisplayMessageBox(std::string message)
@@ -138,12 +161,166 @@ void DisplayWindow::DisplayMessageBox(std::string message)
 
 bool DisplayWindow::DrawAVFrame(AVFrame** video_frame)
 {
-	DisplayUtility::YUV420P_TO_SDLTEXTURE(*video_frame, videoDisplayTexture, &videoDisplayRect);
-	DisplayUtility::DrawTexture(mainWindow_renderer, videoDisplayTexture);
+	if (!video_frame || !*video_frame) return false;
+	AVFrame* frame = *video_frame;
+	Uint32 format = DisplayUtility::AVToSDLPixelFormat(frame->format);
+	if (format == SDL_PIXELFORMAT_UNKNOWN || !PrepareVideoTexture(videoDisplayTexture, format, frame->width, frame->height)) return false;
+
+	//Frame fills the texture, the renderer scales it to videoDisplayRect.
+	if (format == SDL_PIXELFORMAT_NV12) DisplayUtility::NV12_TO_SDLTEXTURE(frame, videoDisplayTexture.texture, NULL);
+	else DisplayUtility::YUV420P_TO_SDLTEXTURE(frame, videoDisplayTexture.texture, NULL);
+	presentedTexture = videoDisplayTexture.texture;
+	DisplayUtility::DrawTexture(mainWindow_renderer, presentedTexture, &videoDisplayRect);
 	//Successful drawing of the frame.
 	return true;
 }
 
+bool DisplayWindow::DrawIntoTexture(AVPixelFormat av_format, int width, int height, const std::function<bool(AVFrame*)>& writePlanes)
+{
+	Uint32 format = DisplayUtility::AVToSDLPixelFormat(av_format);
+	if (format == SDL_PIXELFORMAT_UNKNOWN || !lockedTextureFrame) return false;
+	//The other texture from the one last presented.
+	int index = 1 - lockTextureIndex;
+	VideoTexture& videoTexture = lockTextures[index];
+	if (!PrepareVideoTexture(videoTexture, format, width, height)) return false;
+
+	void* pixels = nullptr;
+	int pitch = 0;
+	if (SDL_LockTexture(videoTexture.texture, NULL, &pixels, &pitch) != 0)
+	{
+		SDL_Log("Unable to lock video texture: %s", SDL_GetError());
+		return false;
+	}
+	//Planar YUV textures are locked as one block: full Y plane, then the chroma plane(s) at half the pitch.
+	AVFrame* frame = lockedTextureFrame;
+	frame->format = av_format;
+	frame->width = width;
+	frame->height = height;
+	uint8_t* planes = static_cast<uint8_t*>(pixels);
+	int chromaPitch = (pitch + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	frame->data[0] = planes;
+	frame->linesize[0] = pitch;
+	frame->data[1] = planes + pitch * height;
+	if (format == SDL_PIXELFORMAT_NV12)
+	{
+		//U and V interleaved, so the chroma plane is as wide as the Y plane.
+		frame->linesize[1] = 2 * chromaPitch;
+	}
+	else
+	{
+		frame->linesize[1] = chromaPitch;
+		frame->data[2] = frame->data[1] + chromaPitch * chromaHeight;
+		frame->linesize[2] = chromaPitch;
+	}
+
+	bool isWritten = writePlanes(frame);
+	SDL_UnlockTexture(videoTexture.texture);
+	//Only valid while locked.
+	for (int plane = 0; plane < AV_NUM_DATA_POINTERS; plane++)
+	{
+		frame->data[plane] = nullptr;
+		frame->linesize[plane] = 0;
+	}
+	if (!isWritten) return false;
+
+	lockTextureIndex = index;
+	presentedTexture = videoTexture.texture;
+	DisplayUtility::DrawTexture(mainWindow_renderer, presentedTexture, &videoDisplayRect);
+	return true;
+}
+
+void DisplayWindow::PresentVideoTexture()
+{
+	if (!presentedTexture) return;
+	DisplayUtility::DrawTexture(mainWindow_renderer, presentedTexture, &videoDisplayRect);
+}
+
+bool DisplayWindow::CanDrawDirectly(int av_format, int width, int height)
+{
+	Uint32 format = DisplayUtility::AVToSDLPixelFormat(av_format);
+	if (format == SDL_PIXELFORMAT_UNKNOWN) return false;
+	//0 means no limit.
+	if (renderer_info.max_texture_width && width > renderer_info.max_texture_width) return false;
+	if (renderer_info.max_texture_height && height > renderer_info.max_texture_height) return false;
+	for (Uint32 i = 0; i < renderer_info.num_texture_formats; i++)
+	{
+		if (renderer_info.texture_formats[i] == format) return true;
+	}
+	return false;
+}
+
+bool DisplayWindow::PrepareVideoTexture(VideoTexture& videoTexture, Uint32 format, int width, int height)
+{
+	if (videoTexture.texture && videoTexture.format == format && videoTexture.width == width && videoTexture.height == height) return true;
+	if (videoTexture.texture == presentedTexture) presentedTexture = nullptr;
+	FreeVideoTexture(videoTexture);
+	videoTexture.texture = SDL_CreateTexture(mainWindow_renderer, format, SDL_TEXTUREACCESS_STREAMING, width, height);
+	if (!videoTexture.texture)
+	{
+		SDL_Log("Failed to init main window's texture");
+		return false;
+	}
+	videoTexture.format = format;
+	videoTexture.width = width;
+	videoTexture.height = height;
+	return true;
+}
+
+void DisplayWindow::FreeVideoTexture(VideoTexture& videoTexture)
+{
+	if (videoTexture.texture) SDL_DestroyTexture(videoTexture.texture);
+	videoTexture = VideoTexture{};
+}
+
+void DisplayWindow::FitVideoDisplayRect()
+{
+	SDL_Rect windowRect{ 0, 0, window_dimensions[0], window_dimensions[1] };
+	//No video yet, so nothing to keep the aspect ratio of.
+	if (videoDimensions.w <= 0 || videoDimensions.h <= 0)
+	{
+		videoDisplayRect = windowRect;
+		return;
+	}
+	videoDisplayRect = DisplayUtility::AdjustRectangle(videoDimensions, windowRect, false);
+}
+
+void DisplayWindow::HandleWindowResize()
+{
+	//Output size rather than window size, as they differ on high DPI displays.
+	int width = 0, height = 0;
+	if (SDL_GetRendererOutputSize(mainWindow_renderer, &width, &height) != 0) SDL_GetWindowSize(mainWindow, &width, &height);
+	if (width <= 0 || height <= 0) return; //Minimized.
+	window_dimensions[0] = width;
+	window_dimensions[1] = height;
+	FitVideoDisplayRect();
+	//Shows the last frame at the new size straight away, even if paused.
+	PresentVideoTexture();
+}
+
+void DisplayWindow::ToggleFullscreen()
+{
+	bool isFullscreen = (SDL_GetWindowFlags(mainWindow) & SDL_WINDOW_FULLSCREEN_DESKTOP) != 0;
+	//Desktop fullscreen doesn't change the display mode, so it's quick and the renderer isn't recreated.
+	if (SDL_SetWindowFullscreen(mainWindow, isFullscreen ? 0 : SDL_WINDOW_FULLSCREEN_DESKTOP) != 0)
+	{
+		SDL_Log("Unable to toggle fullscreen: %s", SDL_GetError());
+	}
+}
+
+SDL_Rect DisplayWindow::GetVideoTextureDimensions(int frameWidth, int frameHeight)
+{
+	SDL_Rect textureDimensions{ 0, 0, frameWidth, frameHeight };
+	//0 means no limit.
+	SDL_Rect limitDimensions{ 0, 0,
+		renderer_info.max_texture_width ? renderer_info.max_texture_width : textureDimensions.w,
+		renderer_info.max_texture_height ? renderer_info.max_texture_height : textureDimensions.h };
+	if (textureDimensions.w <= limitDimensions.w && textureDimensions.h <= limitDimensions.h) return textureDimensions;
+	textureDimensions = DisplayUtility::AdjustRectangle(textureDimensions, limitDimensions, true);
+	textureDimensions.x = textureDimensions.y = 0;
+	return textureDimensions;
+}
+
 
 
 
@@ -152,7 +329,7 @@ namespace DisplayUtility
 {
 	void YUV420P_TO_SDLTEXTURE(AVFrame* imageFrame, SDL_Texture* texture, const SDL_Rect* image_displayArea)
 	{
-		if (!imageFrame || !texture || !image_displayArea) return;
+		if (!imageFrame || !texture) return;
 		if (SDL_UpdateYUVTexture(texture, image_displayArea,
 			imageFrame->data[0], imageFrame->linesize[0],
 			imageFrame->data[1], imageFrame->linesize[1],
@@ -164,10 +341,38 @@ namespace DisplayUtility
 			throw std::exception(msg.c_str());
 		}
 	}
-	void DrawTexture(SDL_Renderer* renderer, SDL_Texture* texture)
+	void NV12_TO_SDLTEXTURE(AVFrame* imageFrame, SDL_Texture* texture, const SDL_Rect* image_displayArea)
+	{
+		if (!imageFrame || !texture) return;
+		if (SDL_UpdateNVTexture(texture, image_displayArea,
+			imageFrame->data[0], imageFrame->linesize[0],
+			imageFrame->data[1], imageFrame->linesize[1]) != 0)
+		{
+			std::string msg = "Unable to convert avframe to texture: ";
+			msg += SDL_GetError();
+			msg += "\n";
+			throw std::exception(msg.c_str());
+		}
+	}
+
+	Uint32 AVToSDLPixelFormat(int av_format)
+	{
+		switch (av_format)
+		{
+		case AV_PIX_FMT_YUV420P:
+		case AV_PIX_FMT_YUVJ420P: //Same layout, only the range differs.
+			return SDL_PIXELFORMAT_IYUV;
+		case AV_PIX_FMT_NV12:
+			return SDL_PIXELFORMAT_NV12;
+		default:
+			return SDL_PIXELFORMAT_UNKNOWN;
+		}
+	}
+
+	void DrawTexture(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* destination)
 	{
 		SDL_RenderClear(renderer);
-		SDL_RenderCopy(renderer, texture, NULL, NULL);
+		SDL_RenderCopy(renderer, texture, NULL, destination);
 		SDL_RenderPresent(renderer);
 	}
 
@@ -2,8 +2,7 @@
 	File Name: Display.hpp
 
 	Brief: Declares functions and class to handle the program's window display.
-
-	TODO: Add capability for window resizing.
+	The video is fitted to the window whenever it's resized or goes in/out of fullscreen.
 */
 
 #ifndef DISPLAY_HPP
@@ -11,20 +10,33 @@
 
 #include "types.hpp"
 #include "ffmpeg_videoFileFunctions.hpp"
+#include <functional>
 namespace DisplayUtility
 {
 	/*
 	Converts a video frame to an sdl texture, only within the rectangular area.
 	Call before changing the texture.
+	image_displayArea can be NULL to fill the whole texture.
 	*/
 	void YUV420P_TO_SDLTEXTURE(AVFrame* imageFrame, SDL_Texture* texture, const SDL_Rect* image_displayArea);
 
+	/*
+	Same as YUV420P_TO_SDLTEXTURE, but for NV12 frames(Y plane, then interleaved UV plane) into an NV12 texture.
+	*/
+	void NV12_TO_SDLTEXTURE(AVFrame* imageFrame, SDL_Texture* texture, const SDL_Rect* image_displayArea);
+
+	/*
+	Returns the SDL texture format the ffmpeg pixel format can be uploaded to as is,
+	or SDL_PIXELFORMAT_UNKNOWN if it needs converting first.
+	*/
+	Uint32 AVToSDLPixelFormat(int av_format);
+
 	/*
 	Inserts sdl texture into the renderer and presents it.
 	Call when texture is finished, as it clears renderer.
-	Will stretch the texture to fill the entire renderer.
+	Will stretch the texture to fill destination, or the entire renderer if destination is NULL.
 	*/
-	void DrawTexture(SDL_Renderer* renderer, SDL_Texture* texture);
+	void DrawTexture(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* destination = NULL);
 
 	/*
 		Will return size of video display rectangle limited to limitDimensions, following aspect ratio.
@@ -33,6 +45,21 @@ namespace DisplayUtility
 	SDL_Rect AdjustRectangle(SDL_Rect videoDimensions, SDL_Rect limitDimensions, bool isTrueSize = false);
 }
 
+//How frames get into video textures.
+enum class UploadMode
+{
+	UPDATE = 0, //Frames are converted on the decode thread into their own buffers, then copied in with SDL_Update*Texture.
+	LOCK, //Frames are converted when drawn, straight into the memory SDL_LockTexture gives. Saves a copy of every frame.
+};
+
+//A streaming texture, and the format and size it was created with.
+struct VideoTexture
+{
+	SDL_Texture* texture = nullptr;
+	Uint32 format = SDL_PIXELFORMAT_UNKNOWN;
+	int width = 0, height = 0;
+};
+
 /*
 	Only one instance of this in the program. Controls the program's window.
 */
@@ -48,13 +75,32 @@ class DisplayWindow
 	NEEDS TO BE LIMITED TO THE VIDEO DIMENSIONS.
 	*/
 	static SDL_Rect videoDisplayRect;
+	//The current video's own dimensions, so videoDisplayRect can be fitted again when the window changes size.
+	static SDL_Rect videoDimensions;
 
 	//The window the program will run on.
 	static SDL_Window* mainWindow;
 	//Used to render the window
 	static SDL_Renderer* mainWindow_renderer;
 	//Used to draw on, before copying to the renderer.
-	static SDL_Texture* videoDisplayTexture;
+	//Sized and formatted to match the frames drawn on it, the renderer scales it to videoDisplayRect.
+	static VideoTexture videoDisplayTexture;
+	//Written to in turn by DrawIntoTexture, so the one last presented is never locked while the renderer may still be reading it.
+	static VideoTexture lockTextures[2];
+	static int lockTextureIndex;
+	//Texture last presented, drawn again by PresentVideoTexture.
+	static SDL_Texture* presentedTexture;
+	//Points into a locked texture's memory while DrawIntoTexture is writing to it. Allocated once.
+	static AVFrame* lockedTextureFrame;
+	static UploadMode uploadMode;
+	//Texture formats and max size the renderer supports.
+	static SDL_RendererInfo renderer_info;
+
+	//(Re)creates the texture if it doesn't match the format and size. Returns false if unable to.
+	static bool PrepareVideoTexture(VideoTexture& videoTexture, Uint32 format, int width, int height);
+	static void FreeVideoTexture(VideoTexture& videoTexture);
+	//Fits videoDisplayRect to the video within the whole window, keeping its aspect ratio. The rest is left black.
+	static void FitVideoDisplayRect();
 
 public:
 
@@ -67,19 +113,53 @@ public:
 	static void Free();
 
 	static void DisplayMessageBox(std::string message);
+	//Uploads the frame as is(YUV420P or NV12), and scales it to the video display area when presenting.
 	static bool DrawAVFrame(AVFrame** video_frame);
+	/*
+		Returns true if frames of that format and size can be drawn without converting them first,
+		i.e. the renderer takes the format and the size is within its texture limits.
+		Safe to call from any thread after Initialize.
+	*/
+	static bool CanDrawDirectly(int av_format, int width, int height);
+	/*
+		Locks the next texture of that format(YUV420P/YUVJ420P or NV12) and size, and gives its memory to writePlanes as a frame
+		with no buffers of its own. writePlanes fills it in(e.g. a converter or scaler writing straight into it), then it's presented.
+		Returns false if unable to, or writePlanes returned false.
+	*/
+	static bool DrawIntoTexture(AVPixelFormat av_format, int width, int height, const std::function<bool(AVFrame*)>& writePlanes);
+
+	//Only read when a video is initialized, so changes apply to the next video.
+	static void SetUploadMode(UploadMode mode) { uploadMode = mode; }
+	static UploadMode GetUploadMode() { return uploadMode; }
+	//Presents the video texture again, without changing it.
+	static void PresentVideoTexture();
+	/*
+		Call when the window changes size(SDL_WINDOWEVENT_SIZE_CHANGED), including going in/out of fullscreen.
+		Only the destination rect changes, the renderer scales the same textures to it, so nothing is redone per frame.
+	*/
+	static void HandleWindowResize();
+	//Switches between windowed and fullscreen(at the desktop's resolution).
+	static void ToggleFullscreen();
 
 	//=======Setters and Getters
 	static SDL_DisplayMode GetDeviceDimensions() { return device_dimensions; }
 	static Vec2 GetWindowDimensions() {
 		return Vec2{ static_cast<double>(window_dimensions[0]), static_cast<double>(window_dimensions[1]) };
 	}
+	//Area of the window the video is drawn in. Main thread only, changes when the window is resized.
 	static SDL_Rect GetVideoDimensions() {
 		return videoDisplayRect;
 	}
+	/*
+		Size to scale frames of that size to when the renderer can't take them as they are, i.e. the frame's own size,
+		shrunk to fit the renderer's max texture size if needed. Doesn't depend on the window, so resizing doesn't change it.
+		Safe to call from any thread after Initialize.
+	*/
+	static SDL_Rect GetVideoTextureDimensions(int frameWidth, int frameHeight);
 	//Needs to be run everytime a new video is used.
 	static void LimitVideoDisplayRect_to_Video(const VideoFile* video_file){
-		videoDisplayRect = DisplayUtility::AdjustRectangle(video_file->GetVideoDimensions(), videoDisplayRect, false);
+		videoDimensions = video_file->GetVideoDimensions();
+		FitVideoDisplayRect();
 	}
 };
 
@@ -0,0 +1,265 @@
+/*
+	File Name: FrameCache.cpp
+
+	Brief: Defines FrameCache, a memory budgeted cache of recently decoded video frames keyed by presentation time.
+	Lets stepping and short backward seeks show frames that were already decoded, instead of decoding again from a keyframe.
+*/
+
+#include "FrameCache.hpp"
+#include <cmath>
+
+FrameCache::FrameCache(int64_t budgetBytes, int maxFrames) : budgetBytes{ budgetBytes }
+{
+	//Allocated once, inserting never allocates an entry.
+	entries.resize(maxFrames > 0 ? maxFrames : 1);
+	for (Entry& entry : entries)
+	{
+		entry.frame = av_frame_alloc();
+	}
+}
+
+FrameCache::~FrameCache()
+{
+	for (Entry& entry : entries)
+	{
+		av_frame_free(&entry.frame);
+	}
+}
+
+bool FrameCache::Insert(const AVFrame* frame, double pts, double duration)
+{
+	int64_t bytes = GetFrameBytes(frame);
+	if (bytes <= 0 || bytes > budgetBytes) return false;
+	std::lock_guard<std::mutex> lock{ mutex };
+	//Decoded again, e.g. after seeking back over it. Same picture, so only keep the newer copy.
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		if (entries[i].isUsed && entries[i].pts == pts)
+		{
+			Evict(i);
+			break;
+		}
+	}
+	int index = PickUnused(frame);
+	if (index < 0)
+	{
+		index = oldest;
+		Evict(index);
+		evictionCount++;
+	}
+	//Buffers that don't fit are replaced, so only the new ones count against the budget.
+	if (!IsReusable(entries[index], frame)) Release(index);
+	//Evicted entries' buffers are freed before any frame is evicted.
+	while (heldBytes + (entries[index].bytes > 0 ? 0 : bytes) > budgetBytes)
+	{
+		int unused = -1;
+		for (int i = 0; i < static_cast<int>(entries.size()) && unused < 0; i++)
+		{
+			if (i != index && !entries[i].isUsed && entries[i].bytes > 0) unused = i;
+		}
+		if (unused >= 0)
+		{
+			Release(unused);
+			continue;
+		}
+		if (oldest < 0) break;
+		int evicted = oldest;
+		Evict(evicted);
+		Release(evicted);
+		evictionCount++;
+	}
+
+	Entry& entry = entries[index];
+	bool isCopied = CopyInto(entry, frame);
+	//Buffers may have been allocated even if the copy failed.
+	heldBytes -= entry.bytes;
+	entry.bytes = GetFrameBytes(entry.frame);
+	heldBytes += entry.bytes;
+	if (!isCopied) return false;
+	entry.pts = pts;
+	entry.duration = duration;
+	entry.isUsed = true;
+	PushNewest(index);
+	usedBytes += entry.bytes;
+	usedCount++;
+	return true;
+}
+
+bool FrameCache::Find(double time, AVFrame* output, double& pts, double& duration)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	//Last frame starting at or before time, if it's still showing then.
+	int found = -1;
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		if (entries[i].isUsed && entries[i].pts <= time && (found < 0 || entries[i].pts > entries[found].pts)) found = i;
+	}
+	if (found >= 0 && time < entries[found].pts + entries[found].duration) return Output(found, output, pts, duration);
+	missCount++;
+	return false;
+}
+
+bool FrameCache::FindNext(double currentPts, double currentDuration, AVFrame* output, double& pts, double& duration)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	int found = -1;
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		if (entries[i].isUsed && entries[i].pts > currentPts && (found < 0 || entries[i].pts < entries[found].pts)) found = i;
+	}
+	//Starts where the current frame ends, give or take timestamp rounding.
+	if (found >= 0 && std::abs(entries[found].pts - (currentPts + currentDuration)) < currentDuration / 2)
+	{
+		return Output(found, output, pts, duration);
+	}
+	missCount++;
+	return false;
+}
+
+bool FrameCache::FindPrevious(double currentPts, AVFrame* output, double& pts, double& duration)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	int found = -1;
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		if (entries[i].isUsed && entries[i].pts < currentPts && (found < 0 || entries[i].pts > entries[found].pts)) found = i;
+	}
+	//Ends where the current frame starts.
+	if (found >= 0 && std::abs(entries[found].pts + entries[found].duration - currentPts) < entries[found].duration / 2)
+	{
+		return Output(found, output, pts, duration);
+	}
+	missCount++;
+	return false;
+}
+
+void FrameCache::Clear()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	while (oldest >= 0) Evict(oldest);
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		Release(i);
+	}
+}
+
+void FrameCache::PrintStats(std::ostream& output) const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	output << "<<Frame cache>>\n"
+		<< "Frames: " << usedCount << "/" << entries.size() << ", " << usedBytes / (1024 * 1024) << " MB, held "
+		<< heldBytes / (1024 * 1024) << "/" << budgetBytes / (1024 * 1024) << " MB\n"
+		<< "Hits: " << hitCount << ", misses " << missCount << ", evictions " << evictionCount << "\n";
+}
+
+bool FrameCache::CopyInto(Entry& entry, const AVFrame* frame)
+{
+	AVFrame* copy = entry.frame;
+	if (!copy) return false;
+	if (!IsReusable(entry, frame))
+	{
+		av_frame_unref(copy);
+		copy->format = frame->format;
+		copy->width = frame->width;
+		copy->height = frame->height;
+		if (av_frame_get_buffer(copy, 0) < 0)
+		{
+			av_frame_unref(copy);
+			return false;
+		}
+	}
+	if (av_frame_copy(copy, frame) < 0) return false;
+	//Only what drawing it needs. Side data isn't copied, as that would allocate.
+	copy->pts = frame->pts;
+	copy->best_effort_timestamp = frame->best_effort_timestamp;
+	copy->pkt_duration = frame->pkt_duration;
+	copy->sample_aspect_ratio = frame->sample_aspect_ratio;
+	copy->color_range = frame->color_range;
+	copy->color_primaries = frame->color_primaries;
+	copy->color_trc = frame->color_trc;
+	copy->colorspace = frame->colorspace;
+	copy->chroma_location = frame->chroma_location;
+	return true;
+}
+
+bool FrameCache::IsReusable(const Entry& entry, const AVFrame* frame)
+{
+	//Buffers from the last frame copied in can be reused, unless a frame Output gave out still references them.
+	const AVFrame* copy = entry.frame;
+	return copy && copy->buf[0] && copy->format == frame->format && copy->width == frame->width && copy->height == frame->height
+		&& av_frame_is_writable(entry.frame);
+}
+
+int FrameCache::PickUnused(const AVFrame* frame) const
+{
+	int empty = -1, other = -1;
+	for (int i = 0; i < static_cast<int>(entries.size()); i++)
+	{
+		const Entry& entry = entries[i];
+		if (entry.isUsed) continue;
+		if (IsReusable(entry, frame)) return i;
+		if (entry.bytes == 0 && empty < 0) empty = i;
+		else if (other < 0) other = i;
+	}
+	return empty >= 0 ? empty : other;
+}
+
+bool FrameCache::Output(int index, AVFrame* output, double& pts, double& duration)
+{
+	Entry& entry = entries[index];
+	av_frame_unref(output);
+	if (av_frame_ref(output, entry.frame) < 0) return false;
+	Unlink(index);
+	PushNewest(index);
+	pts = entry.pts;
+	duration = entry.duration;
+	hitCount++;
+	return true;
+}
+
+void FrameCache::Evict(int index)
+{
+	Entry& entry = entries[index];
+	Unlink(index);
+	usedBytes -= entry.bytes;
+	usedCount--;
+	entry.isUsed = false;
+}
+
+void FrameCache::Release(int index)
+{
+	Entry& entry = entries[index];
+	av_frame_unref(entry.frame);
+	heldBytes -= entry.bytes;
+	entry.bytes = 0;
+}
+
+void FrameCache::Unlink(int index)
+{
+	Entry& entry = entries[index];
+	if (entry.newer >= 0) entries[entry.newer].older = entry.older;
+	else newest = entry.older;
+	if (entry.older >= 0) entries[entry.older].newer = entry.newer;
+	else oldest = entry.newer;
+	entry.newer = entry.older = -1;
+}
+
+void FrameCache::PushNewest(int index)
+{
+	Entry& entry = entries[index];
+	entry.older = newest;
+	entry.newer = -1;
+	if (newest >= 0) entries[newest].newer = index;
+	newest = index;
+	if (oldest < 0) oldest = index;
+}
+
+int64_t FrameCache::GetFrameBytes(const AVFrame* frame)
+{
+	int64_t bytes = 0;
+	for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+	{
+		if (frame->buf[i]) bytes += frame->buf[i]->size;
+	}
+	return bytes;
+}
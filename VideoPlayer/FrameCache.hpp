@@ -0,0 +1,101 @@
+/*
+	File Name: FrameCache.hpp
+
+	Brief: Declares FrameCache, a memory budgeted cache of recently decoded video frames keyed by presentation time.
+	Lets stepping and short backward seeks show frames that were already decoded, instead of decoding again from a keyframe.
+*/
+
+#ifndef FRAMECACHE_HPP
+#define FRAMECACHE_HPP
+#include "types.hpp"
+#include <vector>
+#include <mutex>
+#include <ostream>
+
+/*
+	Frames are copied into a fixed pool of entries allocated up front. Each entry's buffers are allocated with the first frame
+	copied into it and kept for the next frame of that format and size, so the decoder's own buffers are never held on to.
+	The budget counts every entry's buffers, evicted ones included. Those are freed first, then the least recently used frames.
+	Safe to insert from the decode thread while the main thread looks frames up.
+*/
+class FrameCache
+{
+public:
+	//budgetBytes --> Bytes of frame buffers kept at most. maxFrames --> Size of the pool, frames kept at most.
+	FrameCache(int64_t budgetBytes = defaultBudgetBytes, int maxFrames = defaultMaxFrames);
+	~FrameCache();
+
+	FrameCache(const FrameCache& toCopy) = delete;
+	FrameCache& operator=(const FrameCache& rhs) = delete;
+
+	/*
+		Copies frame into the pool, replacing any frame already cached at pts.
+		pts/duration --> In seconds. Duration is what tells apart the next frame from a frame after a gap.
+		Returns false if the frame couldn't be copied(e.g. hardware frames) or is bigger than the whole budget.
+	*/
+	bool Insert(const AVFrame* frame, double pts, double duration);
+
+	/*
+		Each references the frame found into output(which the caller owns), so it stays valid if evicted meanwhile.
+		pts/duration --> Set to the found frame's.
+		Returns false if no such frame is cached.
+	*/
+	//Frame showing at time.
+	bool Find(double time, AVFrame* output, double& pts, double& duration);
+	//Frame right after the one at currentPts, only if nothing was skipped between them(e.g. frames the decoder didn't decode).
+	bool FindNext(double currentPts, double currentDuration, AVFrame* output, double& pts, double& duration);
+	//Frame right before the one at currentPts, only if nothing was skipped between them.
+	bool FindPrevious(double currentPts, AVFrame* output, double& pts, double& duration);
+
+	//Evicts every frame and frees the pool's buffers.
+	void Clear();
+	int64_t GetBudgetBytes() const { return budgetBytes; }
+	//Prints frames kept, bytes they use and bytes held, hits, misses and evictions.
+	void PrintStats(std::ostream& output) const;
+
+	static constexpr int64_t defaultBudgetBytes = 64LL * 1024 * 1024;
+	static constexpr int defaultMaxFrames = 64;
+	//Sum of the sizes of the buffers the frame references.
+	static int64_t GetFrameBytes(const AVFrame* frame);
+
+private:
+	struct Entry
+	{
+		AVFrame* frame = nullptr; //Need to alloc and dealloc. Keeps its buffers while unused.
+		double pts = 0;
+		double duration = 0;
+		int64_t bytes = 0; //Of its buffers, kept while unused.
+		bool isUsed = false;
+		//Neighbouring entries in the LRU list, -1 at either end.
+		int newer = -1, older = -1;
+	};
+
+	//Copies frame into the entry's frame, only allocating buffers if it has none of that format and size(or they're still referenced).
+	bool CopyInto(Entry& entry, const AVFrame* frame);
+	//Whether the entry's buffers can take frame as they are.
+	static bool IsReusable(const Entry& entry, const AVFrame* frame);
+	//Unused entry to copy frame into, ones with buffers that fit first, then ones without any. -1 if every entry is used.
+	int PickUnused(const AVFrame* frame) const;
+	//Refs the entry into output and marks it most recently used. Counts as a hit.
+	bool Output(int index, AVFrame* output, double& pts, double& duration);
+	//Marks the entry unused, keeping its buffers.
+	void Evict(int index);
+	//Frees an evicted entry's buffers.
+	void Release(int index);
+	//LRU list. Unlink takes the entry out, PushNewest puts it at the most recently used end.
+	void Unlink(int index);
+	void PushNewest(int index);
+	int64_t budgetBytes;
+	//Bytes of the frames cached, and of every entry's buffers(what the budget limits).
+	int64_t usedBytes = 0, heldBytes = 0;
+	mutable std::mutex mutex{};
+	//Fixed size, searched in full as it's small.
+	std::vector<Entry> entries{};
+	//Ends of the LRU list, -1 if it's empty.
+	int newest = -1, oldest = -1;
+	int usedCount = 0;
+
+	int hitCount = 0, missCount = 0, evictionCount = 0;
+};
+
+#endif
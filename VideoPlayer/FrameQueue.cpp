@@ -0,0 +1,75 @@
+/*
+	File Name: FrameQueue.cpp
+
+	Brief: Defines FrameQueue, a lock-free single producer/single consumer queue of decoded frames.
+	Used to hand frames from a decode thread to the thread presenting them.
+*/
+
+#include "FrameQueue.hpp"
+
+FrameQueue::FrameQueue(int capacity, bool isRecycleBuffers)
+	: isRecycleBuffers{ isRecycleBuffers }
+{
+	//Frames are allocated once here, and reused for the lifetime of the queue.
+	for (int i = 0; i < capacity; i++)
+	{
+		QueuedFrame slot{};
+		slot.frame = av_frame_alloc();
+		if (!slot.frame) break;
+		slots.push_back(slot);
+	}
+}
+
+FrameQueue::~FrameQueue()
+{
+	for (QueuedFrame& slot : slots)
+	{
+		//Dereference buffer.
+		av_frame_unref(slot.frame);
+		av_frame_free(&slot.frame);
+	}
+}
+
+QueuedFrame* FrameQueue::PeekWritable()
+{
+	unsigned int write = writeIndex.load(std::memory_order_relaxed);
+	//Acquire, so the consumer is done with the slot before it is written to again.
+	unsigned int read = readIndex.load(std::memory_order_acquire);
+	if (slots.empty() || write - read >= slots.size()) return nullptr;
+	return &slots[write % slots.size()];
+}
+
+void FrameQueue::Push()
+{
+	//Release, so the frame's data is visible before the consumer sees the new index.
+	writeIndex.store(writeIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+QueuedFrame* FrameQueue::Peek()
+{
+	unsigned int read = readIndex.load(std::memory_order_relaxed);
+	unsigned int write = writeIndex.load(std::memory_order_acquire);
+	if (write == read) return nullptr;
+	return &slots[read % slots.size()];
+}
+
+QueuedFrame* FrameQueue::PeekNext()
+{
+	unsigned int read = readIndex.load(std::memory_order_relaxed);
+	unsigned int write = writeIndex.load(std::memory_order_acquire);
+	if (write - read < 2) return nullptr;
+	return &slots[(read + 1) % slots.size()];
+}
+
+void FrameQueue::Pop()
+{
+	unsigned int read = readIndex.load(std::memory_order_relaxed);
+	if (writeIndex.load(std::memory_order_acquire) == read) return;
+	if (!isRecycleBuffers) av_frame_unref(slots[read % slots.size()].frame);
+	readIndex.store(read + 1, std::memory_order_release);
+}
+
+int FrameQueue::Size() const
+{
+	return static_cast<int>(writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire));
+}
@@ -0,0 +1,72 @@
+/*
+	File Name: FrameQueue.hpp
+
+	Brief: Declares FrameQueue, a lock-free single producer/single consumer queue of decoded frames.
+	Used to hand frames from a decode thread to the thread presenting them.
+*/
+
+#ifndef FRAMEQUEUE_HPP
+#define FRAMEQUEUE_HPP
+#include "types.hpp"
+#include <vector>
+#include <atomic>
+
+//A decoded frame along with the details needed to schedule it.
+struct QueuedFrame
+{
+	AVFrame* frame = nullptr; //Owned by the queue's pool.
+	int serial = 0; //Seek serial the frame was decoded under. Frames from an older serial are from before a seek.
+	double pts = 0; //Presentation time, in seconds.
+	double duration = 0; //In seconds. The stream's frame interval if the frame had none.
+};
+
+/*
+	Fixed size ring of frames, allocated once and reused.
+	Exactly one thread may write (PeekWritable/Push) and exactly one other thread may read (Peek/Pop).
+	No locks are taken, so neither side can be blocked by the other.
+*/
+class FrameQueue
+{
+public:
+	/*
+		isRecycleBuffers --> Pop keeps the frame's buffers, so the producer can write into them again instead of allocating.
+		Only use if the producer owns the buffers it writes(e.g. scaler output), not references to a decoder's frames.
+	*/
+	FrameQueue(int capacity, bool isRecycleBuffers = false);
+	~FrameQueue();
+
+	FrameQueue(const FrameQueue& toCopy) = delete;
+	FrameQueue& operator=(const FrameQueue& rhs) = delete;
+
+	//=======Producer side
+	/*
+		Returns the next free slot to write into, or nullptr if the queue is full.
+		The slot's frame is blank(unreffed), unless the queue recycles buffers, in which case it still has its buffers from last time.
+		It isn't visible to the consumer until Push is called.
+	*/
+	QueuedFrame* PeekWritable();
+	//Makes the slot from PeekWritable visible to the consumer.
+	void Push();
+
+	//=======Consumer side
+	//Returns the frame at the front of the queue, or nullptr if the queue is empty.
+	QueuedFrame* Peek();
+	//Returns the frame after the front, or nullptr if there isn't one.
+	QueuedFrame* PeekNext();
+	//Releases the front frame back to the producer. Its buffers are unreffed, unless the queue recycles them.
+	void Pop();
+
+	//Number of frames queued. Exact only when called from the producer or consumer thread.
+	int Size() const;
+	int Capacity() const { return static_cast<int>(slots.size()); }
+
+private:
+	std::vector<QueuedFrame> slots{};
+	bool isRecycleBuffers = false;
+	//Both only ever increase, the slot is the index % capacity.
+	//writeIndex is only written by the producer, readIndex only by the consumer.
+	std::atomic<unsigned int> writeIndex{ 0 };
+	std::atomic<unsigned int> readIndex{ 0 };
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+	File Name: FrameScheduler.cpp
+
+	Brief: Defines FrameScheduler, which decides when each decoded video frame is presented, against the master clock.
+	Frames that are already late are dropped, before being resized on the decode thread or uploaded on the main thread.
+*/
+
+#include "FrameScheduler.hpp"
+
+FrameScheduler::FrameScheduler(double refreshInterval)
+	: refreshInterval{ refreshInterval }
+{
+}
+
+bool FrameScheduler::DropDecoded(double pts, double duration, double clock)
+{
+	if (pts + duration >= clock) return false;
+	droppedDecoded++;
+	return true;
+}
+
+AVDiscard FrameScheduler::GetSkipFrame(double pts, double clock)
+{
+	double behind = clock - pts;
+	if (!isSkipping && behind > skipThreshold)
+	{
+		isSkipping = true;
+		skippedPhases++;
+	}
+	//Caught up, decode everything again.
+	else if (isSkipping && behind <= 0)
+	{
+		isSkipping = false;
+	}
+	return isSkipping ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+FrameScheduler::Action FrameScheduler::Schedule(const QueuedFrame& frame, const QueuedFrame* next, double clock)
+{
+	double deadline = clock + refreshInterval / 2;
+	if (frame.pts > deadline) return Action::WAIT;
+	//Next frame is due too, so this one would be replaced before anyone sees it.
+	if (next && next->serial == frame.serial && next->pts <= deadline)
+	{
+		droppedPresented++;
+		return Action::DROP;
+	}
+
+	presented++;
+	double lateness = clock - frame.pts;
+	double lateThreshold = frame.duration > refreshInterval ? frame.duration : refreshInterval;
+	if (lateness > lateThreshold) late++;
+	else if (lateness < 0) early++;
+	return Action::PRESENT;
+}
+
+double FrameScheduler::GetTimeUntilDue(const QueuedFrame& frame, double clock) const
+{
+	double untilDue = frame.pts - (clock + refreshInterval / 2);
+	return untilDue > 0 ? untilDue : 0;
+}
+
+void FrameScheduler::SetRefreshInterval(double seconds)
+{
+	if (seconds > 0) refreshInterval = seconds;
+}
+
+void FrameScheduler::ResetStats()
+{
+	presented = 0;
+	droppedDecoded = 0;
+	droppedPresented = 0;
+	late = 0;
+	early = 0;
+	skippedPhases = 0;
+}
+
+void FrameScheduler::PrintStats(std::ostream& output) const
+{
+	output << "<<Frame Scheduler>>\n"
+		<< "Presented: " << presented
+		<< ", dropped " << droppedDecoded << " before resize/" << droppedPresented << " before upload"
+		<< ", late " << late
+		<< ", early " << early
+		<< ", non-reference skip phases " << skippedPhases << "\n";
+}
@@ -0,0 +1,81 @@
+/*
+	File Name: FrameScheduler.hpp
+
+	Brief: Declares FrameScheduler, which decides when each decoded video frame is presented, against the master clock.
+	Frames that are already late are dropped, before being resized on the decode thread or uploaded on the main thread.
+*/
+
+#ifndef FRAMESCHEDULER_HPP
+#define FRAMESCHEDULER_HPP
+#include "types.hpp"
+#include "FrameQueue.hpp"
+#include <atomic>
+#include <ostream>
+
+/*
+	Decode side(DropDecoded/GetSkipFrame) is called only from the video decode thread,
+	presentation side(Schedule) only from the main thread. Counts can be read from either.
+*/
+class FrameScheduler
+{
+public:
+	enum class Action
+	{
+		WAIT = 0, //Not due yet, keep showing the current frame.
+		PRESENT, //Due now.
+		DROP, //Too late, a later frame is already due.
+	};
+
+	//refreshInterval --> Seconds between the display's refreshes.
+	FrameScheduler(double refreshInterval = 1.0 / 60);
+
+	//=======Decode side
+	/*
+		Returns true if the frame ends before clock, so it would be late even if presented straight away.
+		duration --> Must not be 0, pass the frame interval for frames without one. Otherwise slightly late frames are dropped.
+		Counted as dropped.
+	*/
+	bool DropDecoded(double pts, double duration, double clock);
+	/*
+		Returns what the video decoder should skip, given how far behind clock the last decoded frame is.
+		Skips non-reference frames once decode is more than skipThreshold behind, until it catches up.
+	*/
+	AVDiscard GetSkipFrame(double pts, double clock);
+
+	//=======Presentation side
+	/*
+		Decides what to do with the frame at the front of the queue. next is the frame after it, or nullptr.
+		Frames are due within half a refresh of their pts, so they land on the refresh closest to it.
+	*/
+	Action Schedule(const QueuedFrame& frame, const QueuedFrame* next, double clock);
+	//Seconds until Schedule would present the frame, 0 if it's already due.
+	double GetTimeUntilDue(const QueuedFrame& frame, double clock) const;
+
+	void SetRefreshInterval(double seconds);
+	//Resets all counts.
+	void ResetStats();
+	//Prints presented/dropped/late/early counts.
+	void PrintStats(std::ostream& output) const;
+
+	int GetPresentedCount() const { return presented; }
+	int GetDroppedCount() const { return droppedDecoded + droppedPresented; }
+	int GetLateCount() const { return late; }
+	int GetEarlyCount() const { return early; }
+
+	//Seconds decode can fall behind the clock before non-reference frames are skipped.
+	static constexpr double skipThreshold = 0.5;
+
+private:
+	double refreshInterval;
+	//Only touched by the decode thread.
+	bool isSkipping = false;
+
+	std::atomic<int> presented{ 0 };
+	std::atomic<int> droppedDecoded{ 0 }; //Dropped before being resized.
+	std::atomic<int> droppedPresented{ 0 }; //Dropped before being uploaded.
+	std::atomic<int> late{ 0 }; //Presented more than a frame after its pts.
+	std::atomic<int> early{ 0 }; //Presented before its pts(within half a refresh).
+	std::atomic<int> skippedPhases{ 0 }; //Number of times the decoder started skipping non-reference frames.
+};
+
+#endif
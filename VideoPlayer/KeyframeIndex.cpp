@@ -0,0 +1,197 @@
+/*
+	File Name: KeyframeIndex.cpp
+
+	Brief: Defines KeyframeIndex, which finds every keyframe of the video stream on a low priority background thread,
+	from packet flags only(nothing is decoded), so seeks can land on the keyframe right before their target.
+	The index is kept in a sidecar file, so files indexed before don't need it built again.
+*/
+
+#include "KeyframeIndex.hpp"
+#include "ProbeCache.hpp"
+#include "Windows.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+namespace
+{
+	using ProbeCache::Write;
+	using ProbeCache::Read;
+
+	//Header is ProbeCache's, so it's keyed to the media file the same way.
+	const char keyframeIndexMagic[ProbeCache::sidecarMagicSize] = { 'V', 'P', 'K', 'E', 'Y', 'I', 'D', '1' };
+	//pts, position and frameCount, written field by field so there's no padding.
+	const int64_t keyframeEntryBytes = 20;
+
+	bool IsEarlier(const KeyframeEntry& lhs, const KeyframeEntry& rhs)
+	{
+		return lhs.pts < rhs.pts;
+	}
+}
+
+const char* const KeyframeIndex::keyframeIndexExtension = ".keyindex";
+
+KeyframeIndex::KeyframeIndex(const std::string& fileName, int streamIndex)
+	: fileName{ fileName }, streamIndex{ streamIndex }
+{
+	if (LoadSidecar())
+	{
+		isLoaded = true;
+		isComplete = true;
+		return;
+	}
+	buildThread = std::thread{ &KeyframeIndex::Build, this };
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+	isStopRequested = true;
+	if (buildThread.joinable()) buildThread.join();
+}
+
+bool KeyframeIndex::Find(double seconds, KeyframeEntry& keyframe) const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	if (keyframes.empty() || timeBase.num <= 0) return false;
+	KeyframeEntry target{};
+	target.pts = static_cast<int64_t>(seconds / av_q2d(timeBase));
+	//First keyframe after the target, the one before it is the answer.
+	std::vector<KeyframeEntry>::const_iterator after = std::upper_bound(keyframes.begin(), keyframes.end(), target, IsEarlier);
+	//Still building, and the next keyframe may not be indexed yet.
+	if (after == keyframes.end() && !isComplete) return false;
+	if (after == keyframes.begin()) return false;
+	keyframe = *(after - 1);
+	return true;
+}
+
+void KeyframeIndex::PrintStats(std::ostream& output) const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	output << "<<Keyframe index>>\n"
+		<< "Keyframes: " << keyframes.size() << (isComplete ? "" : " (incomplete)");
+	if (isLoaded) output << ", loaded from sidecar\n";
+	else output << ", built in " << buildSeconds * 1000 << " ms\n";
+}
+
+void KeyframeIndex::Build()
+{
+	//Only reads ahead of when it's needed, so it shouldn't take CPU or disk time from playback.
+	SetCurrentThreadBackground();
+	auto buildStart = std::chrono::steady_clock::now();
+
+	AVFormatContext* container = nullptr;
+	if (avformat_open_input(&container, fileName.c_str(), NULL, NULL) != 0) return;
+	//Formats that only find their streams while reading(e.g. MPEG-TS) need probing to line up stream indexes.
+	if (static_cast<int>(container->nb_streams) <= streamIndex && avformat_find_stream_info(container, NULL) < 0)
+	{
+		avformat_close_input(&container);
+		return;
+	}
+	if (static_cast<int>(container->nb_streams) <= streamIndex
+		|| container->streams[streamIndex]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+	{
+		avformat_close_input(&container);
+		return;
+	}
+	//Only the video stream's packets are needed.
+	for (unsigned int i = 0; i < container->nb_streams; i++)
+	{
+		if (static_cast<int>(i) != streamIndex) container->streams[i]->discard = AVDISCARD_ALL;
+	}
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		timeBase = container->streams[streamIndex]->time_base;
+	}
+
+	AVPacket* packet = av_packet_alloc();
+	bool isEOF = false;
+	while (packet && !isStopRequested)
+	{
+		int errVal = av_read_frame(container, packet);
+		if (errVal == AVERROR(EAGAIN)) continue;
+		if (errVal < 0)
+		{
+			isEOF = errVal == AVERROR_EOF;
+			break;
+		}
+		if (packet->stream_index == streamIndex)
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (packet->flags & AV_PKT_FLAG_KEY)
+			{
+				KeyframeEntry keyframe{};
+				keyframe.pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+				keyframe.position = packet->pos;
+				if (keyframe.pts != AV_NOPTS_VALUE)
+				{
+					//Keyframes come in pts order for almost every file, so this is nearly always an append.
+					std::vector<KeyframeEntry>::iterator at = std::upper_bound(keyframes.begin(), keyframes.end(), keyframe, IsEarlier);
+					keyframes.insert(at, keyframe);
+				}
+			}
+			//Counts towards the GOP of the last keyframe read.
+			if (!keyframes.empty()) keyframes.back().frameCount++;
+		}
+		av_packet_unref(packet);
+	}
+	av_packet_free(&packet);
+	avformat_close_input(&container);
+
+	buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+	//Incomplete indexes(stopped early or a read error) aren't kept.
+	if (!isEOF) return;
+	isComplete = true;
+	SaveSidecar();
+}
+
+bool KeyframeIndex::LoadSidecar()
+{
+	ProbeCache::FileStamp stamp{};
+	if (!ProbeCache::GetFileStamp(fileName, stamp)) return false;
+	std::ifstream input{ fileName + keyframeIndexExtension, std::ios::binary };
+	if (!input) return false;
+
+	if (!ProbeCache::ReadSidecarHeader(input, keyframeIndexMagic, fileName, stamp)) return false;
+
+	int32_t cachedStreamIndex = 0;
+	AVRational cachedTimeBase{};
+	uint32_t count = 0;
+	if (!Read(input, cachedStreamIndex) || !Read(input, cachedTimeBase) || !Read(input, count)) return false;
+	if (cachedStreamIndex != streamIndex || cachedTimeBase.num <= 0 || cachedTimeBase.den <= 0) return false;
+	//A damaged count can't ask for more keyframes than the rest of the sidecar holds.
+	std::streampos entriesStart = input.tellg();
+	if (entriesStart < 0 || !input.seekg(0, std::ios::end)) return false;
+	int64_t remainingBytes = static_cast<int64_t>(input.tellg() - entriesStart);
+	if (!input.seekg(entriesStart) || count > remainingBytes / keyframeEntryBytes) return false;
+	std::vector<KeyframeEntry> loaded(count);
+	for (KeyframeEntry& keyframe : loaded)
+	{
+		if (!Read(input, keyframe.pts) || !Read(input, keyframe.position) || !Read(input, keyframe.frameCount)) return false;
+	}
+
+	std::lock_guard<std::mutex> lock{ mutex };
+	timeBase = cachedTimeBase;
+	keyframes.swap(loaded);
+	return true;
+}
+
+bool KeyframeIndex::SaveSidecar() const
+{
+	ProbeCache::FileStamp stamp{};
+	if (!ProbeCache::GetFileStamp(fileName, stamp)) return false;
+	std::ofstream output{ fileName + keyframeIndexExtension, std::ios::binary | std::ios::trunc };
+	if (!output) return false;
+
+	std::lock_guard<std::mutex> lock{ mutex };
+	ProbeCache::WriteSidecarHeader(output, keyframeIndexMagic, fileName, stamp);
+	Write(output, static_cast<int32_t>(streamIndex));
+	Write(output, timeBase);
+	Write(output, static_cast<uint32_t>(keyframes.size()));
+	for (const KeyframeEntry& keyframe : keyframes)
+	{
+		Write(output, keyframe.pts);
+		Write(output, keyframe.position);
+		Write(output, keyframe.frameCount);
+	}
+	return static_cast<bool>(output);
+}
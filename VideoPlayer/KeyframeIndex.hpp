@@ -0,0 +1,82 @@
+/*
+	File Name: KeyframeIndex.hpp
+
+	Brief: Declares KeyframeIndex, which finds every keyframe of the video stream on a low priority background thread,
+	from packet flags only(nothing is decoded), so seeks can land on the keyframe right before their target.
+	The index is kept in a sidecar file, so files indexed before don't need it built again.
+*/
+
+#ifndef KEYFRAMEINDEX_HPP
+#define KEYFRAMEINDEX_HPP
+#include "types.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <ostream>
+
+//One keyframe, and the GOP(group of pictures) it starts.
+struct KeyframeEntry
+{
+	int64_t pts = 0; //In the stream's time base.
+	int64_t position = -1; //Byte position of the keyframe's packet in the file, -1 if unknown.
+	int32_t frameCount = 0; //Packets from this keyframe up to the next one.
+};
+
+/*
+	Builds with its own AVFormatContext, so it never touches the one being played.
+	Find can be called from any thread while it builds.
+*/
+class KeyframeIndex
+{
+public:
+	/*
+		Loads the index from its sidecar, else starts building it.
+		streamIndex --> Video stream to index, must match the stream's index in the player's container.
+	*/
+	KeyframeIndex(const std::string& fileName, int streamIndex);
+	//Stops building, the sidecar is only written once complete.
+	~KeyframeIndex();
+
+	KeyframeIndex(const KeyframeIndex& toCopy) = delete;
+	KeyframeIndex& operator=(const KeyframeIndex& rhs) = delete;
+
+	/*
+		Finds the last keyframe at or before seconds. Returns false if the index doesn't reach that far yet,
+		as a keyframe not indexed yet could be closer.
+	*/
+	bool Find(double seconds, KeyframeEntry& keyframe) const;
+	//Seconds of the keyframe's pts.
+	double GetSeconds(const KeyframeEntry& keyframe) const { return keyframe.pts * av_q2d(timeBase); }
+
+	//True once every keyframe is indexed.
+	bool IsComplete() const { return isComplete; }
+	//Prints the number of keyframes, how long the build took, and whether it came from the sidecar.
+	void PrintStats(std::ostream& output) const;
+
+	//Added to the media file's name for its sidecar.
+	static const char* const keyframeIndexExtension;
+
+private:
+	//Build thread's loop. Reads every packet of the file, keeping the keyframes of the video stream.
+	void Build();
+	bool LoadSidecar();
+	bool SaveSidecar() const;
+
+	std::string fileName;
+	int streamIndex;
+	AVRational timeBase{ 0, 1 };
+
+	//Sorted by pts. Guards timeBase as well while building.
+	mutable std::mutex mutex{};
+	std::vector<KeyframeEntry> keyframes{};
+
+	std::thread buildThread{};
+	std::atomic<bool> isStopRequested{ false };
+	std::atomic<bool> isComplete{ false };
+	bool isLoaded = false;
+	double buildSeconds = 0;
+};
+
+#endif
@@ -0,0 +1,511 @@
+/*
+	File Name: PixelConvert.cpp
+
+	Brief: Defines PixelConvert, vectorized conversions from common decoder output formats to I420(YUV420P),
+	the layout DisplayWindow's texture takes. Only the layout/bit depth changes, the size stays the same.
+	Picks AVX2, SSE4.1 or plain C kernels at runtime, by what the CPU supports.
+
+	Every kernel works on a single row, and the vector versions finish off the end of the row with the plain C one,
+	so all levels give exactly the same output.
+	Converters are templates specialized on the source format and SIMD level, so their loops have no format checks.
+	The table of them is built at compile time, and one is looked up per stream rather than per frame.
+*/
+
+#include "PixelConvert.hpp"
+#include <vector>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXELCONVERT_X86 1
+#include <immintrin.h>
+//MSVC allows any intrinsics anywhere, GCC/Clang need the function marked for the instruction set it uses.
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXELCONVERT_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+#define PIXELCONVERT_TARGET(instructionSet)
+#endif
+#endif
+
+namespace
+{
+	/*
+		Row kernels for one level, as static functions so converters call them directly:
+		Deinterleave --> Splits count interleaved pairs into u and v.
+		AverageRows --> Rounded average of two rows.
+		Decimate2x2 --> Rounded average of each 2x2 block of two rows. width is the input width, output is half of it(rounded up).
+		Narrow16 --> Shifts 16 bit samples right by shift(at least 1) and saturates them to 8 bits.
+	*/
+	template <PixelConvert::SimdLevel level>
+	struct Kernels;
+
+#define PIXELCONVERT_KERNELS(level, suffix) \
+	template <> \
+	struct Kernels<level> \
+	{ \
+		static void Deinterleave(const uint8_t* uv, uint8_t* u, uint8_t* v, int count) { Deinterleave##suffix(uv, u, v, count); } \
+		static void AverageRows(const uint8_t* a, const uint8_t* b, uint8_t* out, int count) { AverageRows##suffix(a, b, out, count); } \
+		static void Decimate2x2(const uint8_t* a, const uint8_t* b, uint8_t* out, int width) { Decimate2x2##suffix(a, b, out, width); } \
+		static void Narrow16(const uint16_t* in, uint8_t* out, int count, int shift) { Narrow16##suffix(in, out, count, shift); } \
+	};
+
+	//=======Plain C
+	void DeinterleaveScalar(const uint8_t* uv, uint8_t* u, uint8_t* v, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			u[i] = uv[2 * i];
+			v[i] = uv[2 * i + 1];
+		}
+	}
+
+	void AverageRowsScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			out[i] = static_cast<uint8_t>((a[i] + b[i] + 1) >> 1);
+		}
+	}
+
+	void Decimate2x2Scalar(const uint8_t* a, const uint8_t* b, uint8_t* out, int width)
+	{
+		int i = 0;
+		for (; 2 * i + 1 < width; i++)
+		{
+			out[i] = static_cast<uint8_t>((a[2 * i] + a[2 * i + 1] + b[2 * i] + b[2 * i + 1] + 2) >> 2);
+		}
+		//Odd width, last column has no pair.
+		if (2 * i < width) out[i] = static_cast<uint8_t>((a[2 * i] + b[2 * i] + 1) >> 1);
+	}
+
+	void Narrow16Scalar(const uint16_t* in, uint8_t* out, int count, int shift)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int value = in[i] >> shift;
+			out[i] = static_cast<uint8_t>(value > 255 ? 255 : value);
+		}
+	}
+
+	PIXELCONVERT_KERNELS(PixelConvert::SimdLevel::SCALAR, Scalar)
+
+#ifdef PIXELCONVERT_X86
+	//=======SSE4.1
+	PIXELCONVERT_TARGET("sse4.1")
+	void DeinterleaveSSE41(const uint8_t* uv, uint8_t* u, uint8_t* v, int count)
+	{
+		const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i pairs0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + 2 * i));
+			__m128i pairs1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + 2 * i + 16));
+			__m128i uOut = _mm_packus_epi16(_mm_and_si128(pairs0, lowBytes), _mm_and_si128(pairs1, lowBytes));
+			__m128i vOut = _mm_packus_epi16(_mm_srli_epi16(pairs0, 8), _mm_srli_epi16(pairs1, 8));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(u + i), uOut);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), vOut);
+		}
+		DeinterleaveScalar(uv + 2 * i, u + i, v + i, count - i);
+	}
+
+	PIXELCONVERT_TARGET("sse4.1")
+	void AverageRowsSSE41(const uint8_t* a, const uint8_t* b, uint8_t* out, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i rowA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			__m128i rowB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_avg_epu8(rowA, rowB));
+		}
+		AverageRowsScalar(a + i, b + i, out + i, count - i);
+	}
+
+	PIXELCONVERT_TARGET("sse4.1")
+	void Decimate2x2SSE41(const uint8_t* a, const uint8_t* b, uint8_t* out, int width)
+	{
+		const __m128i ones = _mm_set1_epi8(1);
+		const __m128i two = _mm_set1_epi16(2);
+		int i = 0;
+		for (; 2 * i + 32 <= width; i += 16)
+		{
+			//Adds each horizontal pair into 16 bits.
+			__m128i sumA0 = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * i)), ones);
+			__m128i sumA1 = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 2 * i + 16)), ones);
+			__m128i sumB0 = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * i)), ones);
+			__m128i sumB1 = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 2 * i + 16)), ones);
+			__m128i sum0 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sumA0, sumB0), two), 2);
+			__m128i sum1 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(sumA1, sumB1), two), 2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(sum0, sum1));
+		}
+		Decimate2x2Scalar(a + 2 * i, b + 2 * i, out + i, width - 2 * i);
+	}
+
+	PIXELCONVERT_TARGET("sse4.1")
+	void Narrow16SSE41(const uint16_t* in, uint8_t* out, int count, int shift)
+	{
+		const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i samples0 = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), shiftCount);
+			__m128i samples1 = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8)), shiftCount);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(samples0, samples1));
+		}
+		Narrow16Scalar(in + i, out + i, count - i, shift);
+	}
+
+	PIXELCONVERT_KERNELS(PixelConvert::SimdLevel::SSE41, SSE41)
+
+	//=======AVX2
+	//Packs work within each 128 bit lane, this puts the 64 bit quarters back in order afterwards.
+#define PIXELCONVERT_FIX_PACK_ORDER(packed) _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0))
+
+	PIXELCONVERT_TARGET("avx2")
+	void DeinterleaveAVX2(const uint8_t* uv, uint8_t* u, uint8_t* v, int count)
+	{
+		const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i pairs0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + 2 * i));
+			__m256i pairs1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + 2 * i + 32));
+			__m256i uOut = _mm256_packus_epi16(_mm256_and_si256(pairs0, lowBytes), _mm256_and_si256(pairs1, lowBytes));
+			__m256i vOut = _mm256_packus_epi16(_mm256_srli_epi16(pairs0, 8), _mm256_srli_epi16(pairs1, 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(u + i), PIXELCONVERT_FIX_PACK_ORDER(uOut));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), PIXELCONVERT_FIX_PACK_ORDER(vOut));
+		}
+		DeinterleaveScalar(uv + 2 * i, u + i, v + i, count - i);
+	}
+
+	PIXELCONVERT_TARGET("avx2")
+	void AverageRowsAVX2(const uint8_t* a, const uint8_t* b, uint8_t* out, int count)
+	{
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i rowA = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			__m256i rowB = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_avg_epu8(rowA, rowB));
+		}
+		AverageRowsScalar(a + i, b + i, out + i, count - i);
+	}
+
+	PIXELCONVERT_TARGET("avx2")
+	void Decimate2x2AVX2(const uint8_t* a, const uint8_t* b, uint8_t* out, int width)
+	{
+		const __m256i ones = _mm256_set1_epi8(1);
+		const __m256i two = _mm256_set1_epi16(2);
+		int i = 0;
+		for (; 2 * i + 64 <= width; i += 32)
+		{
+			__m256i sumA0 = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 2 * i)), ones);
+			__m256i sumA1 = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 2 * i + 32)), ones);
+			__m256i sumB0 = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * i)), ones);
+			__m256i sumB1 = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * i + 32)), ones);
+			__m256i sum0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(sumA0, sumB0), two), 2);
+			__m256i sum1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(sumA1, sumB1), two), 2);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), PIXELCONVERT_FIX_PACK_ORDER(_mm256_packus_epi16(sum0, sum1)));
+		}
+		Decimate2x2Scalar(a + 2 * i, b + 2 * i, out + i, width - 2 * i);
+	}
+
+	PIXELCONVERT_TARGET("avx2")
+	void Narrow16AVX2(const uint16_t* in, uint8_t* out, int count, int shift)
+	{
+		const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i samples0 = _mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), shiftCount);
+			__m256i samples1 = _mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16)), shiftCount);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), PIXELCONVERT_FIX_PACK_ORDER(_mm256_packus_epi16(samples0, samples1)));
+		}
+		Narrow16Scalar(in + i, out + i, count - i, shift);
+	}
+
+	PIXELCONVERT_KERNELS(PixelConvert::SimdLevel::AVX2, AVX2)
+#else
+	//Only plain C off x86, GetSupportedLevel never goes above it.
+	PIXELCONVERT_KERNELS(PixelConvert::SimdLevel::SSE41, Scalar)
+	PIXELCONVERT_KERNELS(PixelConvert::SimdLevel::AVX2, Scalar)
+#endif
+
+	PixelConvert::SimdLevel currentLevel = PixelConvert::GetSupportedLevel();
+
+	//Rounded up half.
+	int Half(int value)
+	{
+		return (value + 1) / 2;
+	}
+
+	//Gives frame YUV420P buffers of that size, reusing the ones it has if they fit.
+	bool PrepareI420Frame(AVFrame* frame, int width, int height, AVPixelFormat format)
+	{
+		//Either its own buffers from last time, or planes the caller owns(e.g. a locked texture), which are written in place.
+		bool isCallerOwned = !frame->buf[0] && frame->data[0];
+		if ((isCallerOwned || (frame->buf[0] && av_frame_is_writable(frame)))
+			&& frame->format == format && frame->width == width && frame->height == height)
+		{
+			return true;
+		}
+		av_frame_unref(frame);
+		frame->format = format;
+		frame->width = width;
+		frame->height = height;
+		return av_frame_get_buffer(frame, 64) >= 0;
+	}
+
+	//Rows converters work in, kept per thread and only ever grown, so steady playback doesn't allocate.
+	uint8_t* GetScratchRows(int rowBytes, int rowCount)
+	{
+		thread_local std::vector<uint8_t> scratch{};
+		size_t needed = static_cast<size_t>(rowBytes) * rowCount;
+		if (scratch.size() < needed) scratch.resize(needed);
+		return scratch.data();
+	}
+
+	/*
+		Describes a source format at compile time, so the converter for it has no format checks.
+		chromaShiftX/Y --> log2 of the chroma subsampling, e.g. 1,1 for 4:2:0, 1,0 for 4:2:2 and 0,0 for 4:4:4.
+		isSemiPlanar --> U and V are interleaved in one plane, e.g. NV12.
+		isVFirst --> V comes before U, e.g. NV21.
+		bytesPerSample --> 1 for 8 bits, 2 for more.
+		dropBits --> Low bits dropped to narrow 2 byte samples to 8 bits.
+	*/
+	template <int chromaShiftXValue, int chromaShiftYValue, bool isSemiPlanarValue, bool isVFirstValue, int bytesPerSampleValue, int dropBitsValue>
+	struct SourceFormat
+	{
+		static constexpr int chromaShiftX = chromaShiftXValue;
+		static constexpr int chromaShiftY = chromaShiftYValue;
+		static constexpr bool isSemiPlanar = isSemiPlanarValue;
+		static constexpr bool isVFirst = isVFirstValue;
+		static constexpr int bytesPerSample = bytesPerSampleValue;
+		static constexpr int dropBits = dropBitsValue;
+	};
+	typedef SourceFormat<1, 1, true, false, 1, 0> NV12Source;
+	typedef SourceFormat<1, 1, true, true, 1, 0> NV21Source;
+	typedef SourceFormat<1, 0, false, false, 1, 0> YUV422PSource;
+	typedef SourceFormat<0, 0, false, false, 1, 0> YUV444PSource;
+	//P010 keeps its 10 bits in the high bits of each sample, the planar 10 bit formats in the low bits.
+	typedef SourceFormat<1, 1, true, false, 2, 8> P010Source;
+	typedef SourceFormat<1, 1, false, false, 2, 2> YUV420P10Source;
+	typedef SourceFormat<1, 0, false, false, 2, 2> YUV422P10Source;
+	typedef SourceFormat<0, 0, false, false, 2, 2> YUV444P10Source;
+
+	/*
+		Gets one source chroma row as 8 bit planar U and V.
+		Points straight into the source if it already is, otherwise converts into u/v(pairs is scratch for semi planar narrowing).
+	*/
+	template <class Source, PixelConvert::SimdLevel level>
+	void LoadChromaRow(const AVFrame* src, int row, int samples, uint8_t* u, uint8_t* v, uint8_t* pairs, const uint8_t*& uOut, const uint8_t*& vOut)
+	{
+		typedef Kernels<level> K;
+		if (Source::isSemiPlanar)
+		{
+			const uint8_t* interleaved = src->data[1] + row * src->linesize[1];
+			if (Source::bytesPerSample == 2)
+			{
+				K::Narrow16(reinterpret_cast<const uint16_t*>(interleaved), pairs, 2 * samples, Source::dropBits);
+				interleaved = pairs;
+			}
+			if (Source::isVFirst) K::Deinterleave(interleaved, v, u, samples);
+			else K::Deinterleave(interleaved, u, v, samples);
+			uOut = u;
+			vOut = v;
+			return;
+		}
+		const uint8_t* uRow = src->data[1] + row * src->linesize[1];
+		const uint8_t* vRow = src->data[2] + row * src->linesize[2];
+		if (Source::bytesPerSample == 2)
+		{
+			K::Narrow16(reinterpret_cast<const uint16_t*>(uRow), u, samples, Source::dropBits);
+			K::Narrow16(reinterpret_cast<const uint16_t*>(vRow), v, samples, Source::dropBits);
+			uOut = u;
+			vOut = v;
+			return;
+		}
+		uOut = uRow;
+		vOut = vRow;
+	}
+
+	//Converts src to dstFormat(YUV420P or YUVJ420P) at the same size.
+	template <class Source, AVPixelFormat dstFormat, PixelConvert::SimdLevel level>
+	bool ConvertFrame(const AVFrame* src, AVFrame* dst)
+	{
+		static_assert(Source::chromaShiftX >= Source::chromaShiftY, "Only 4:2:0, 4:2:2 and 4:4:4 sources are supported");
+		typedef Kernels<level> K;
+		int width = src->width, height = src->height;
+		int chromaWidth = Half(width), chromaHeight = Half(height);
+		if (!PrepareI420Frame(dst, width, height, dstFormat)) return false;
+
+		//Luma only changes if it needs narrowing.
+		if (Source::bytesPerSample == 1)
+		{
+			av_image_copy_plane(dst->data[0], dst->linesize[0], src->data[0], src->linesize[0], width, height);
+		}
+		else
+		{
+			for (int y = 0; y < height; y++)
+			{
+				K::Narrow16(reinterpret_cast<const uint16_t*>(src->data[0] + y * src->linesize[0]),
+					dst->data[0] + y * dst->linesize[0], width, Source::dropBits);
+			}
+		}
+
+		int srcChromaWidth = Source::chromaShiftX ? chromaWidth : width;
+		int srcChromaHeight = Source::chromaShiftY ? chromaHeight : height;
+		uint8_t* scratch = GetScratchRows(srcChromaWidth, 6);
+		uint8_t* uA = scratch;
+		uint8_t* vA = scratch + srcChromaWidth;
+		uint8_t* uB = scratch + 2 * srcChromaWidth;
+		uint8_t* vB = scratch + 3 * srcChromaWidth;
+		uint8_t* pairs = scratch + 4 * srcChromaWidth;
+		for (int y = 0; y < chromaHeight; y++)
+		{
+			uint8_t* uDst = dst->data[1] + y * dst->linesize[1];
+			uint8_t* vDst = dst->data[2] + y * dst->linesize[2];
+			const uint8_t* uRowA;
+			const uint8_t* vRowA;
+			if (Source::chromaShiftY)
+			{
+				//Already 4:2:0, so anything that needs converting goes straight into the output.
+				LoadChromaRow<Source, level>(src, y, srcChromaWidth, uDst, vDst, pairs, uRowA, vRowA);
+				if (uRowA != uDst) std::memcpy(uDst, uRowA, chromaWidth);
+				if (vRowA != vDst) std::memcpy(vDst, vRowA, chromaWidth);
+				continue;
+			}
+
+			//Averages each pair of rows, the last row pairs with itself if the height is odd.
+			const uint8_t* uRowB;
+			const uint8_t* vRowB;
+			int rowB = 2 * y + 1 < srcChromaHeight ? 2 * y + 1 : 2 * y;
+			LoadChromaRow<Source, level>(src, 2 * y, srcChromaWidth, uA, vA, pairs, uRowA, vRowA);
+			LoadChromaRow<Source, level>(src, rowB, srcChromaWidth, uB, vB, pairs, uRowB, vRowB);
+			if (Source::chromaShiftX)
+			{
+				K::AverageRows(uRowA, uRowB, uDst, chromaWidth);
+				K::AverageRows(vRowA, vRowB, vDst, chromaWidth);
+			}
+			else
+			{
+				K::Decimate2x2(uRowA, uRowB, uDst, width);
+				K::Decimate2x2(vRowA, vRowB, vDst, width);
+			}
+		}
+
+		//So that the new frame will have the old frame's time.
+		dst->pts = src->pts;
+		dst->pkt_dts = src->pkt_dts;
+		dst->best_effort_timestamp = src->best_effort_timestamp;
+		dst->pkt_duration = src->pkt_duration;
+		dst->key_frame = src->key_frame;
+		dst->pict_type = src->pict_type;
+		dst->sample_aspect_ratio = src->sample_aspect_ratio;
+		return true;
+	}
+
+	struct ConverterEntry
+	{
+		AVPixelFormat srcFormat;
+		AVPixelFormat dstFormat;
+		//Indexed by SimdLevel.
+		PixelConvert::Converter converters[static_cast<int>(PixelConvert::SimdLevel::END)];
+	};
+
+#define PIXELCONVERT_ENTRY(srcFormat, dstFormat, Source) \
+	{ srcFormat, dstFormat, { \
+		&ConvertFrame<Source, dstFormat, PixelConvert::SimdLevel::SCALAR>, \
+		&ConvertFrame<Source, dstFormat, PixelConvert::SimdLevel::SSE41>, \
+		&ConvertFrame<Source, dstFormat, PixelConvert::SimdLevel::AVX2> } }
+
+	//Every specialized pair, each level its own instantiation.
+	constexpr ConverterEntry converterTable[] = {
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, NV12Source),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_NV21, AV_PIX_FMT_YUV420P, NV21Source),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV420P, YUV422PSource),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_YUVJ420P, YUV422PSource),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUV444P, AV_PIX_FMT_YUV420P, YUV444PSource),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUVJ444P, AV_PIX_FMT_YUVJ420P, YUV444PSource),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P, P010Source),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, YUV420P10Source),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUV422P10LE, AV_PIX_FMT_YUV420P, YUV422P10Source),
+		PIXELCONVERT_ENTRY(AV_PIX_FMT_YUV444P10LE, AV_PIX_FMT_YUV420P, YUV444P10Source),
+	};
+	constexpr int converterCount = static_cast<int>(sizeof(converterTable) / sizeof(converterTable[0]));
+}
+
+namespace PixelConvert
+{
+	const char* GetSimdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::AVX2:
+			return "AVX2";
+		case SimdLevel::SSE41:
+			return "SSE4.1";
+		default:
+			return "Scalar";
+		}
+	}
+
+	SimdLevel GetSupportedLevel()
+	{
+#ifdef PIXELCONVERT_X86
+		int flags = av_get_cpu_flags();
+		if (flags & AV_CPU_FLAG_AVX2) return SimdLevel::AVX2;
+		if (flags & AV_CPU_FLAG_SSE4) return SimdLevel::SSE41;
+#endif
+		return SimdLevel::SCALAR;
+	}
+
+	SimdLevel GetLevel()
+	{
+		return currentLevel;
+	}
+
+	void SetLevel(SimdLevel level)
+	{
+		SimdLevel supported = GetSupportedLevel();
+		currentLevel = static_cast<int>(level) > static_cast<int>(supported) ? supported : level;
+	}
+
+	Converter FindConverter(int srcFormat, int dstFormat)
+	{
+		for (const ConverterEntry& entry : converterTable)
+		{
+			if (entry.srcFormat == srcFormat && entry.dstFormat == dstFormat) return entry.converters[static_cast<int>(currentLevel)];
+		}
+		return nullptr;
+	}
+
+	AVPixelFormat GetI420Format(int srcFormat)
+	{
+		return (srcFormat == AV_PIX_FMT_YUVJ422P || srcFormat == AV_PIX_FMT_YUVJ444P) ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+	}
+
+	int GetConverterCount()
+	{
+		return converterCount;
+	}
+
+	bool GetConverterFormats(int index, AVPixelFormat& srcFormat, AVPixelFormat& dstFormat)
+	{
+		if (index < 0 || index >= converterCount) return false;
+		srcFormat = converterTable[index].srcFormat;
+		dstFormat = converterTable[index].dstFormat;
+		return true;
+	}
+
+	bool CanConvertToI420(int av_format)
+	{
+		return FindConverter(av_format, GetI420Format(av_format)) != nullptr;
+	}
+
+	bool ConvertToI420(const AVFrame* src, AVFrame* dst)
+	{
+		if (!src || !dst) return false;
+		Converter converter = FindConverter(src->format, GetI420Format(src->format));
+		return converter && converter(src, dst);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+	File Name: PixelConvert.hpp
+
+	Brief: Declares PixelConvert, vectorized conversions from common decoder output formats to I420(YUV420P),
+	the layout DisplayWindow's texture takes. Only the layout/bit depth changes, the size stays the same.
+	Picks AVX2, SSE4.1 or plain C kernels at runtime, by what the CPU supports.
+	Each format pair has its own converter specialized at compile time, looked up once per stream with FindConverter.
+*/
+
+#ifndef PIXELCONVERT_HPP
+#define PIXELCONVERT_HPP
+#include "types.hpp"
+
+namespace PixelConvert
+{
+	//Instruction sets the kernels are written for, from slowest to fastest.
+	enum class SimdLevel
+	{
+		SCALAR = 0,
+		SSE41,
+		AVX2,
+		END
+	};
+
+	const char* GetSimdLevelName(SimdLevel level);
+	//Best level the CPU(and OS) supports, from CPUID through av_get_cpu_flags.
+	SimdLevel GetSupportedLevel();
+	//Level conversions currently use. Starts at GetSupportedLevel.
+	SimdLevel GetLevel();
+	//Forces a lower level, e.g. to compare against in benchmarks. Clamped to GetSupportedLevel.
+	void SetLevel(SimdLevel level);
+
+	/*
+		Converts src to the pair's destination format at the same size, and stores it in dst.
+		dst's buffers are reused if they already fit, so pass in the same frames every time.
+		If dst has planes but no buffers(e.g. pointing into a locked texture) and already fits, it's written into in place.
+		Chroma is decimated by averaging(rounded), 10 bit samples are narrowed by dropping the low bits.
+		Returns false if unable to.
+	*/
+	typedef bool (*Converter)(const AVFrame* src, AVFrame* dst);
+	/*
+		Returns the converter specialized for that pair at the current level, or nullptr if there isn't one.
+		Look it up when the stream's format is known rather than every frame, and again if the level changes.
+	*/
+	Converter FindConverter(int srcFormat, int dstFormat);
+	//Format to convert that source to for DisplayWindow, YUVJ420P for full range sources and YUV420P otherwise.
+	AVPixelFormat GetI420Format(int srcFormat);
+	//Number of specialized pairs, and the formats of each. For benchmarks.
+	int GetConverterCount();
+	bool GetConverterFormats(int index, AVPixelFormat& srcFormat, AVPixelFormat& dstFormat);
+
+	/*
+		Returns true if ConvertToI420 takes that format:
+		NV12, NV21, YUV422P, YUV444P(and their full range J versions), P010 and YUV420P10/422P10/444P10.
+	*/
+	bool CanConvertToI420(int av_format);
+	//Converts src to GetI420Format(src's format). Looks up the converter every call, use FindConverter for per frame work.
+	bool ConvertToI420(const AVFrame* src, AVFrame* dst);
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+	File Name: ProbeCache.cpp
+
+	Brief: Defines ProbeCache, which keeps the stream parameters found by probing a media file in a small sidecar file,
+	so reopening the same file can skip probing(avformat_find_stream_info) entirely.
+*/
+
+#include "ProbeCache.hpp"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace
+{
+	using ProbeCache::Write;
+	using ProbeCache::Read;
+
+	const char probeCacheMagic[ProbeCache::sidecarMagicSize] = { 'V', 'P', 'P', 'R', 'O', 'B', 'E', '1' };
+
+	//What probing finds for one stream. Plain values, so it can be written/read as a whole.
+	struct CachedStream
+	{
+		int32_t codecType, codecId;
+		uint32_t codecTag;
+		int32_t format;
+		int64_t bitRate;
+		int32_t bitsPerCodedSample, bitsPerRawSample, profile, level;
+		int32_t width, height;
+		AVRational sampleAspectRatio;
+		int32_t fieldOrder, colorRange, colorPrimaries, colorTrc, colorSpace, chromaLocation, videoDelay;
+		uint64_t channelLayout;
+		int32_t channels, sampleRate, blockAlign, frameSize, initialPadding, seekPreroll;
+		AVRational timeBase, avgFrameRate, realFrameRate;
+		int64_t startTime, duration;
+		int32_t disposition;
+		int32_t extradataSize;
+	};
+
+	void ToCache(const AVStream* stream, CachedStream& cached)
+	{
+		const AVCodecParameters* param = stream->codecpar;
+		std::memset(&cached, 0, sizeof(cached));
+		cached.codecType = param->codec_type;
+		cached.codecId = param->codec_id;
+		cached.codecTag = param->codec_tag;
+		cached.format = param->format;
+		cached.bitRate = param->bit_rate;
+		cached.bitsPerCodedSample = param->bits_per_coded_sample;
+		cached.bitsPerRawSample = param->bits_per_raw_sample;
+		cached.profile = param->profile;
+		cached.level = param->level;
+		cached.width = param->width;
+		cached.height = param->height;
+		cached.sampleAspectRatio = param->sample_aspect_ratio;
+		cached.fieldOrder = param->field_order;
+		cached.colorRange = param->color_range;
+		cached.colorPrimaries = param->color_primaries;
+		cached.colorTrc = param->color_trc;
+		cached.colorSpace = param->color_space;
+		cached.chromaLocation = param->chroma_location;
+		cached.videoDelay = param->video_delay;
+		cached.channelLayout = param->channel_layout;
+		cached.channels = param->channels;
+		cached.sampleRate = param->sample_rate;
+		cached.blockAlign = param->block_align;
+		cached.frameSize = param->frame_size;
+		cached.initialPadding = param->initial_padding;
+		cached.seekPreroll = param->seek_preroll;
+		cached.timeBase = stream->time_base;
+		cached.avgFrameRate = stream->avg_frame_rate;
+		cached.realFrameRate = stream->r_frame_rate;
+		cached.startTime = stream->start_time;
+		cached.duration = stream->duration;
+		cached.disposition = stream->disposition;
+		cached.extradataSize = param->extradata ? param->extradata_size : 0;
+	}
+
+	//Returns false if unable to allocate the extradata.
+	bool FromCache(const CachedStream& cached, const std::vector<uint8_t>& extradata, AVStream* stream)
+	{
+		AVCodecParameters* param = stream->codecpar;
+		if (!extradata.empty())
+		{
+			//Decoders read past the end, so it needs padding.
+			uint8_t* data = static_cast<uint8_t*>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+			if (!data) return false;
+			std::memcpy(data, extradata.data(), extradata.size());
+			av_freep(&param->extradata);
+			param->extradata = data;
+			param->extradata_size = static_cast<int>(extradata.size());
+		}
+		param->codec_type = static_cast<AVMediaType>(cached.codecType);
+		param->codec_id = static_cast<AVCodecID>(cached.codecId);
+		param->codec_tag = cached.codecTag;
+		param->format = cached.format;
+		param->bit_rate = cached.bitRate;
+		param->bits_per_coded_sample = cached.bitsPerCodedSample;
+		param->bits_per_raw_sample = cached.bitsPerRawSample;
+		param->profile = cached.profile;
+		param->level = cached.level;
+		param->width = cached.width;
+		param->height = cached.height;
+		param->sample_aspect_ratio = cached.sampleAspectRatio;
+		param->field_order = static_cast<AVFieldOrder>(cached.fieldOrder);
+		param->color_range = static_cast<AVColorRange>(cached.colorRange);
+		param->color_primaries = static_cast<AVColorPrimaries>(cached.colorPrimaries);
+		param->color_trc = static_cast<AVColorTransferCharacteristic>(cached.colorTrc);
+		param->color_space = static_cast<AVColorSpace>(cached.colorSpace);
+		param->chroma_location = static_cast<AVChromaLocation>(cached.chromaLocation);
+		param->video_delay = cached.videoDelay;
+		param->channel_layout = cached.channelLayout;
+		param->channels = cached.channels;
+		param->sample_rate = cached.sampleRate;
+		param->block_align = cached.blockAlign;
+		param->frame_size = cached.frameSize;
+		param->initial_padding = cached.initialPadding;
+		param->seek_preroll = cached.seekPreroll;
+		stream->avg_frame_rate = cached.avgFrameRate;
+		stream->r_frame_rate = cached.realFrameRate;
+		stream->start_time = cached.startTime;
+		stream->duration = cached.duration;
+		stream->disposition = cached.disposition;
+		return true;
+	}
+}
+
+namespace ProbeCache
+{
+	const char* const probeCacheExtension = ".probecache";
+
+	bool GetFileStamp(const std::string& fileName, FileStamp& stamp)
+	{
+#ifdef _WIN32
+		//Plain stat only has 32 bit sizes on Windows.
+		struct _stat64 status;
+		if (_stat64(fileName.c_str(), &status) != 0) return false;
+#else
+		struct stat status;
+		if (stat(fileName.c_str(), &status) != 0) return false;
+#endif
+		stamp.size = static_cast<int64_t>(status.st_size);
+		stamp.modifiedTime = static_cast<int64_t>(status.st_mtime);
+		return true;
+	}
+
+	void WriteSidecarHeader(std::ostream& output, const char* magic, const std::string& fileName, const FileStamp& stamp)
+	{
+		output.write(magic, sidecarMagicSize);
+		Write(output, static_cast<uint32_t>(fileName.size()));
+		output.write(fileName.data(), fileName.size());
+		Write(output, stamp.size);
+		Write(output, stamp.modifiedTime);
+	}
+
+	bool ReadSidecarHeader(std::istream& input, const char* magic, const std::string& fileName, const FileStamp& stamp)
+	{
+		char cachedMagic[sidecarMagicSize]{};
+		if (!input.read(cachedMagic, sizeof(cachedMagic)) || std::memcmp(cachedMagic, magic, sizeof(cachedMagic)) != 0) return false;
+		uint32_t pathLength = 0;
+		if (!Read(input, pathLength) || pathLength != fileName.size()) return false;
+		std::string path(pathLength, '\0');
+		if (!input.read(&path[0], pathLength) || path != fileName) return false;
+		FileStamp cachedStamp{};
+		if (!Read(input, cachedStamp.size) || !Read(input, cachedStamp.modifiedTime)) return false;
+		return cachedStamp.size == stamp.size && cachedStamp.modifiedTime == stamp.modifiedTime;
+	}
+
+	std::string GetCachePath(const std::string& fileName)
+	{
+		return fileName + probeCacheExtension;
+	}
+
+	bool Load(const std::string& fileName, AVFormatContext* container)
+	{
+		FileStamp stamp{};
+		if (!container || !GetFileStamp(fileName, stamp)) return false;
+		std::ifstream input{ GetCachePath(fileName), std::ios::binary };
+		if (!input) return false;
+
+		if (!ReadSidecarHeader(input, probeCacheMagic, fileName, stamp)) return false;
+
+		int64_t duration = 0, startTime = 0, bitRate = 0;
+		uint32_t streamCount = 0;
+		if (!Read(input, duration) || !Read(input, startTime) || !Read(input, bitRate) || !Read(input, streamCount)) return false;
+		if (streamCount != container->nb_streams) return false;
+
+		//Everything's read and checked before any of it is applied, so a bad sidecar leaves the container as it was.
+		std::vector<CachedStream> streams(streamCount);
+		std::vector<std::vector<uint8_t>> extradata(streamCount);
+		for (uint32_t i = 0; i < streamCount; i++)
+		{
+			if (!Read(input, streams[i])) return false;
+			if (streams[i].extradataSize < 0 || streams[i].extradataSize > (1 << 24)) return false;
+			extradata[i].resize(streams[i].extradataSize);
+			if (!extradata[i].empty() && !input.read(reinterpret_cast<char*>(extradata[i].data()), extradata[i].size())) return false;
+			//Set by the demuxer from the file's header, so it must already agree.
+			const AVStream* stream = container->streams[i];
+			if (streams[i].timeBase.num != stream->time_base.num || streams[i].timeBase.den != stream->time_base.den) return false;
+		}
+
+		for (uint32_t i = 0; i < streamCount; i++)
+		{
+			if (!FromCache(streams[i], extradata[i], container->streams[i])) return false;
+		}
+		container->duration = duration;
+		container->start_time = startTime;
+		container->bit_rate = bitRate;
+		return true;
+	}
+
+	bool Save(const std::string& fileName, const AVFormatContext* container)
+	{
+		FileStamp stamp{};
+		if (!container || !GetFileStamp(fileName, stamp)) return false;
+		//Capped probing may not have found everything, don't keep that for next time.
+		for (unsigned int i = 0; i < container->nb_streams; i++)
+		{
+			const AVCodecParameters* param = container->streams[i]->codecpar;
+			if (param->codec_type == AVMEDIA_TYPE_VIDEO && (param->format < 0 || param->width <= 0 || param->height <= 0)) return false;
+			if (param->codec_type == AVMEDIA_TYPE_AUDIO && (param->format < 0 || param->sample_rate <= 0 || param->channels <= 0)) return false;
+		}
+		std::ofstream output{ GetCachePath(fileName), std::ios::binary | std::ios::trunc };
+		if (!output) return false;
+
+		WriteSidecarHeader(output, probeCacheMagic, fileName, stamp);
+		Write(output, static_cast<int64_t>(container->duration));
+		Write(output, static_cast<int64_t>(container->start_time));
+		Write(output, static_cast<int64_t>(container->bit_rate));
+		Write(output, static_cast<uint32_t>(container->nb_streams));
+		for (unsigned int i = 0; i < container->nb_streams; i++)
+		{
+			CachedStream cached;
+			ToCache(container->streams[i], cached);
+			Write(output, cached);
+			if (cached.extradataSize > 0) output.write(reinterpret_cast<const char*>(container->streams[i]->codecpar->extradata), cached.extradataSize);
+		}
+		return static_cast<bool>(output);
+	}
+}
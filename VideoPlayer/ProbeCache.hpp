@@ -0,0 +1,64 @@
+/*
+	File Name: ProbeCache.hpp
+
+	Brief: Declares ProbeCache, which keeps the stream parameters found by probing a media file in a small sidecar file,
+	so reopening the same file can skip probing(avformat_find_stream_info) entirely.
+*/
+
+#ifndef PROBECACHE_HPP
+#define PROBECACHE_HPP
+#include "types.hpp"
+#include <string>
+#include <istream>
+#include <ostream>
+
+/*
+	The sidecar sits next to the media file, with probeCacheExtension added to its name.
+	It's keyed by the media file's path, size and modification time, so it's ignored once the file changes.
+*/
+namespace ProbeCache
+{
+	//Added to the media file's name for its sidecar.
+	extern const char* const probeCacheExtension;
+
+	//Identifies one version of a media file, for keying sidecars.
+	struct FileStamp
+	{
+		int64_t size = 0;
+		int64_t modifiedTime = 0;
+	};
+	//Returns false if the file can't be found, e.g. it's a URL.
+	bool GetFileStamp(const std::string& fileName, FileStamp& stamp);
+
+	//=======Shared by every sidecar(e.g. KeyframeIndex's as well)
+	//Length of the magic each kind of sidecar starts with, changed whenever its layout changes so old ones are ignored.
+	const int sidecarMagicSize = 8;
+	//Key every sidecar starts with: magic, then the media file's path, size and modification time.
+	void WriteSidecarHeader(std::ostream& output, const char* magic, const std::string& fileName, const FileStamp& stamp);
+	//Returns false if the sidecar is of another kind or layout, or for another file or version of it.
+	bool ReadSidecarHeader(std::istream& input, const char* magic, const std::string& fileName, const FileStamp& stamp);
+
+	//Sidecars are only read back on the machine that wrote them, so values are stored as they are in memory.
+	template <typename T>
+	void Write(std::ostream& output, const T& value)
+	{
+		output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+	template <typename T>
+	bool Read(std::istream& input, T& value)
+	{
+		return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	std::string GetCachePath(const std::string& fileName);
+	/*
+		Fills in each stream's codec parameters and frame rates from the sidecar, for a container that's opened but not probed.
+		Returns false without changing anything if there's no sidecar, it's for a different version of the file,
+		or the container's streams don't match the ones cached(e.g. formats that only find their streams while probing).
+	*/
+	bool Load(const std::string& fileName, AVFormatContext* container);
+	//Writes the sidecar for a probed container. Returns false if unable to(e.g. the folder is read only), or probing left a stream incomplete.
+	bool Save(const std::string& fileName, const AVFormatContext* container);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+	File Name: QualityGovernor.cpp
+
+	Brief: Defines QualityGovernor, which steps video decode/scale quality down when they can't keep up with the frame rate,
+	and back up once there's headroom again.
+*/
+
+#include "QualityGovernor.hpp"
+
+bool QualityGovernor::Update(double decodeSeconds, double frameInterval)
+{
+	if (frameInterval <= 0) return false;
+	double decode = decodeLoad + smoothing * (decodeSeconds / frameInterval - decodeLoad);
+	double scale = scaleLoad + smoothing * (scaleSeconds / frameInterval - scaleLoad);
+	decodeLoad = decode;
+	scaleLoad = scale;
+
+	double load = decode + scale;
+	overloadedCount = load > overloadLoad ? overloadedCount + 1 : 0;
+	headroomCount = load < headroomLoad ? headroomCount + 1 : 0;
+
+	Stage current = stage;
+	Stage next = current;
+	if (overloadedCount >= overloadFrames && current != Stage::LOWRES)
+	{
+		next = static_cast<Stage>(static_cast<int>(current) + 1);
+		stepsDown++;
+	}
+	else if (headroomCount >= headroomFrames && current != Stage::FULL)
+	{
+		next = static_cast<Stage>(static_cast<int>(current) - 1);
+		stepsUp++;
+	}
+	if (next == current) return false;
+
+	//Each stage gets a full window to show its effect before the next step.
+	stage = next;
+	overloadedCount = headroomCount = 0;
+	return true;
+}
+
+void QualityGovernor::Reset()
+{
+	stage = Stage::FULL;
+	scaleSeconds = 0;
+	decodeLoad = scaleLoad = 0;
+	overloadedCount = headroomCount = 0;
+	stepsDown = stepsUp = 0;
+}
+
+void QualityGovernor::PrintStats(std::ostream& output) const
+{
+	output << "<<Quality governor>>\n"
+		<< "Stage: " << GetStageName(stage) << "\n"
+		<< "Steps down: " << stepsDown << ", steps up: " << stepsUp << "\n"
+		<< "Decode load: " << decodeLoad * 100 << "%, scale load: " << scaleLoad * 100 << "%\n";
+}
+
+const char* QualityGovernor::GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::FULL:
+		return "full quality";
+	case Stage::BILINEAR_SCALE:
+		return "bilinear scaling";
+	case Stage::FAST_BILINEAR_SCALE:
+		return "fast bilinear scaling";
+	case Stage::SKIP_LOOP_FILTER:
+		return "loop filter skipped";
+	case Stage::SKIP_NONREF:
+		return "non-reference frames skipped";
+	case Stage::LOWRES:
+		return "reduced decode resolution";
+	case Stage::END:
+	default:
+		return "unknown";
+	}
+}
+
+int QualityGovernor::GetScaleFlags() const
+{
+	Stage current = stage;
+	if (current >= Stage::FAST_BILINEAR_SCALE) return SWS_FAST_BILINEAR;
+	if (current >= Stage::BILINEAR_SCALE) return SWS_BILINEAR;
+	return SWS_BICUBIC;
+}
@@ -0,0 +1,82 @@
+/*
+	File Name: QualityGovernor.hpp
+
+	Brief: Declares QualityGovernor, which steps video decode/scale quality down when they can't keep up with the frame rate,
+	and back up once there's headroom again.
+*/
+
+#ifndef QUALITYGOVERNOR_HPP
+#define QUALITYGOVERNOR_HPP
+#include "types.hpp"
+#include <atomic>
+#include <ostream>
+
+/*
+	Each stage keeps everything the stages before it gave up, so quality goes down one step at a time.
+	Decode side(Update) is called only from the video decode thread. Scale time and the current stage can be used from any thread.
+*/
+class QualityGovernor
+{
+public:
+	enum class Stage
+	{
+		FULL = 0, //Bicubic scaling, full decoding.
+		BILINEAR_SCALE,
+		FAST_BILINEAR_SCALE,
+		SKIP_LOOP_FILTER,
+		SKIP_NONREF, //Skips frames nothing else refers to, so fewer frames are shown.
+		LOWRES, //Decodes at half resolution, or as close as the codec can get.
+		END, //Used for the number of stages.
+	};
+
+	/*
+		Records how long the last frame took to decode, against the time it's shown for.
+		Returns true if the stage changed, the new stage's settings should then be applied.
+		frameInterval --> Seconds the frame is shown for.
+	*/
+	bool Update(double decodeSeconds, double frameInterval);
+	//Records how long the last frame took to convert/scale. Called by whichever thread scales, included in the next Update.
+	void SetScaleTime(double seconds) { scaleSeconds = seconds; }
+
+	//Back to full quality, e.g. for a new video.
+	void Reset();
+	//Prints the current stage and the number of steps taken each way.
+	void PrintStats(std::ostream& output) const;
+
+	Stage GetStage() const { return stage; }
+	static const char* GetStageName(Stage stage);
+	//Smoothed decode/scale time as a fraction of the frame interval.
+	double GetDecodeLoad() const { return decodeLoad; }
+	double GetScaleLoad() const { return scaleLoad; }
+
+	//=======Settings for the current stage.
+	//sws flags to scale with.
+	int GetScaleFlags() const;
+	bool IsSkipLoopFilter() const { return stage >= Stage::SKIP_LOOP_FILTER; }
+	AVDiscard GetSkipFrame() const { return stage >= Stage::SKIP_NONREF ? AVDISCARD_NONREF : AVDISCARD_DEFAULT; }
+	//Least the decode resolution is reduced by(log2).
+	int GetMinDecodeReduction() const { return stage >= Stage::LOWRES ? 1 : 0; }
+
+	//Load(decode + scale time over the frame interval) above which a frame counts as overloaded.
+	static constexpr double overloadLoad = 0.85;
+	//Load below which a frame counts as having headroom.
+	static constexpr double headroomLoad = 0.5;
+	//Frames in a row overloaded before stepping down, so single slow frames(e.g. keyframes) don't.
+	static const int overloadFrames = 30;
+	//Frames in a row with headroom before stepping up. Longer than overloadFrames, so it doesn't flip back and forth.
+	static const int headroomFrames = 180;
+	//Weight of each new frame's time in the smoothed loads.
+	static constexpr double smoothing = 0.1;
+
+private:
+	std::atomic<Stage> stage{ Stage::FULL };
+	std::atomic<double> scaleSeconds{ 0 };
+	//Only written by the decode thread.
+	std::atomic<double> decodeLoad{ 0 }, scaleLoad{ 0 };
+	int overloadedCount = 0;
+	int headroomCount = 0;
+
+	std::atomic<int> stepsDown{ 0 }, stepsUp{ 0 };
+};
+
+#endif
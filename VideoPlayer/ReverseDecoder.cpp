@@ -0,0 +1,321 @@
+/*
+	File Name: ReverseDecoder.cpp
+
+	Brief: Defines ReverseDecoder, which decodes the video backwards for reverse playback.
+	The video is split into chunks(a GOP, or part of one if it's too big), each decoded forwards from its keyframe on a worker thread,
+	so their frames can be shown in reverse. Chunks before the one being shown are decoded ahead of time.
+*/
+
+#include "ReverseDecoder.hpp"
+#include "FrameCache.hpp"
+#include "Utility.hpp"
+#include <algorithm>
+#include <limits>
+
+ReverseDecoder::ReverseDecoder(const std::string& fileName, const AVStream* stream, const KeyframeIndex* keyframeIndex, double startSeconds,
+	const ReverseConfig& config)
+	: fileName{ fileName }, streamIndex{ stream->index }, timeBase{ stream->time_base }, keyframeIndex{ keyframeIndex }, config{ config }
+{
+	if (this->config.workerCount < 1) this->config.workerCount = 1;
+	codecParameters = avcodec_parameters_alloc();
+	if (codecParameters && avcodec_parameters_copy(codecParameters, stream->codecpar) < 0) avcodec_parameters_free(&codecParameters);
+	frameInterval = stream->avg_frame_rate.num > 0 ? av_q2d(av_inv_q(stream->avg_frame_rate)) : 1.0 / 30;
+	if (stream->start_time != AV_NOPTS_VALUE) streamStartSeconds = stream->start_time * av_q2d(timeBase);
+	//Until a chunk is decoded, frames are taken to be the size of one unpadded frame at the stream's size.
+	int frameBytes = av_image_get_buffer_size(static_cast<AVPixelFormat>(stream->codecpar->format), stream->codecpar->width, stream->codecpar->height, 1);
+	averageFrameBytes = frameBytes > 0 ? frameBytes : 1920 * 1080 * 3 / 2;
+	//Workers share the cores, rather than each starting a thread per core.
+	int cores = static_cast<int>(std::thread::hardware_concurrency());
+	threadsPerWorker = cores / this->config.workerCount > 1 ? cores / this->config.workerCount : 1;
+
+	//Frame showing at startSeconds is the first one shown.
+	planEnd = startSeconds + frameInterval / 2;
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		PlanChunks();
+	}
+	if (!codecParameters)
+	{
+		failedWorkerCount = this->config.workerCount;
+		return;
+	}
+	for (int i = 0; i < this->config.workerCount; i++)
+	{
+		workers.push_back(std::thread{ &ReverseDecoder::Work, this });
+	}
+}
+
+ReverseDecoder::~ReverseDecoder()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		isStopRequested = true;
+	}
+	chunkPlanned.notify_all();
+	for (std::thread& worker : workers)
+	{
+		if (worker.joinable()) worker.join();
+	}
+	while (!chunks.empty()) PopChunk();
+	avcodec_parameters_free(&codecParameters);
+}
+
+bool ReverseDecoder::GetFrame(double seconds, AVFrame* output, double& pts, double& duration)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	while (!chunks.empty() && chunks.front()->state == ChunkState::DONE)
+	{
+		Chunk& chunk = *chunks.front();
+		std::vector<ReverseFrame>& frames = chunk.frames;
+		//Already shown, playing backwards won't need them again. The first frame of the video stays up once reached.
+		while (!frames.empty() && frames.back().pts > seconds && !(chunk.isFirst && frames.size() == 1))
+		{
+			FreeFrame(frames.back());
+			frames.pop_back();
+		}
+		if (!frames.empty())
+		{
+			const ReverseFrame& shown = frames.back();
+			av_frame_unref(output);
+			if (av_frame_ref(output, shown.frame) < 0) return false;
+			pts = shown.pts;
+			duration = shown.duration;
+			if (pts != lastShownPts)
+			{
+				lastShownPts = pts;
+				shownCount++;
+			}
+			if (chunk.isFirst && frames.size() == 1 && seconds < pts) isAtStart = true;
+			if (isStalled)
+			{
+				isStalled = false;
+				stallSeconds += Utility::GetTime() - stallStart;
+			}
+			return true;
+		}
+		//Nothing at all before it, e.g. the video starts with frames that can't be decoded.
+		if (chunk.isFirst)
+		{
+			isAtStart = true;
+			return false;
+		}
+		//Every frame of it has been shown, carry on with the chunk before it.
+		PopChunk();
+		PlanChunks();
+	}
+	//Still decoding the chunk needed next.
+	if (!isStalled && !chunks.empty())
+	{
+		isStalled = true;
+		stallStart = Utility::GetTime();
+		stallCount++;
+	}
+	return false;
+}
+
+void ReverseDecoder::PrintStats(std::ostream& output) const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	output << "<<Reverse playback>>\n"
+		<< "Chunks decoded: " << chunkCount << ", frames decoded " << decodedCount << ", kept " << keptCount << ", shown " << shownCount << "\n";
+	if (keptCount > 0 && decodeSeconds > 0)
+	{
+		output << "Decode: " << keptCount / decodeSeconds << " frames kept per second per worker (" << config.workerCount << " workers)"
+			<< ", " << static_cast<double>(decodedCount) / keptCount << " frames decoded per frame kept\n";
+	}
+	output << "Frames held: peak " << peakBytes / (1024 * 1024) << " MB, chunks of at most " << config.chunkBytes / (1024 * 1024) << " MB\n"
+		<< "Stalls: " << stallCount << ", " << stallSeconds * 1000 << " ms in total\n";
+}
+
+int64_t ReverseDecoder::GetPeakBytes() const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return peakBytes;
+}
+
+void ReverseDecoder::Work()
+{
+	AVFormatContext* container = nullptr;
+	AVCodecContext* codecContext = nullptr;
+	const AVCodec* codec = avcodec_find_decoder(codecParameters->codec_id);
+	bool isOpened = avformat_open_input(&container, fileName.c_str(), NULL, NULL) == 0;
+	//Formats that only find their streams while reading(e.g. MPEG-TS) need probing to line up stream indexes.
+	if (isOpened && static_cast<int>(container->nb_streams) <= streamIndex) isOpened = avformat_find_stream_info(container, NULL) >= 0;
+	isOpened = isOpened && static_cast<int>(container->nb_streams) > streamIndex && codec
+		&& (codecContext = avcodec_alloc_context3(codec)) != nullptr
+		&& avcodec_parameters_to_context(codecContext, codecParameters) >= 0;
+	if (isOpened)
+	{
+		codecContext->pkt_timebase = container->streams[streamIndex]->time_base;
+		//Throughput is all that matters, frames are only shown once the whole chunk is decoded.
+		codecContext->thread_count = threadsPerWorker;
+		codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		isOpened = avcodec_open2(codecContext, codec, NULL) >= 0;
+	}
+	AVPacket* packet = av_packet_alloc();
+	AVFrame* frame = av_frame_alloc();
+	if (isOpened && packet && frame)
+	{
+		//Only the video stream's packets are needed.
+		for (unsigned int i = 0; i < container->nb_streams; i++)
+		{
+			if (static_cast<int>(i) != streamIndex) container->streams[i]->discard = AVDISCARD_ALL;
+		}
+		while (true)
+		{
+			Chunk* chunk = nullptr;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				//Chunks are planned latest first, so the first pending one is needed soonest.
+				chunkPlanned.wait(lock, [&]() {
+					if (isStopRequested) return true;
+					for (std::unique_ptr<Chunk>& planned : chunks)
+					{
+						if (planned->state != ChunkState::PENDING) continue;
+						chunk = planned.get();
+						return true;
+					}
+					return false;
+				});
+				if (isStopRequested) break;
+				chunk->state = ChunkState::DECODING;
+			}
+
+			double decodeStart = Utility::GetTime();
+			std::vector<ReverseFrame> frames{};
+			int decoded = DecodeChunk(container, codecContext, packet, frame, *chunk, frames);
+			std::sort(frames.begin(), frames.end(), [](const ReverseFrame& lhs, const ReverseFrame& rhs) { return lhs.pts < rhs.pts; });
+			int64_t bytes = 0;
+			for (const ReverseFrame& reverseFrame : frames) bytes += reverseFrame.bytes;
+
+			std::lock_guard<std::mutex> lock{ mutex };
+			chunk->frames.swap(frames);
+			chunk->state = ChunkState::DONE;
+			heldBytes += bytes;
+			if (heldBytes > peakBytes) peakBytes = heldBytes;
+			if (!chunk->frames.empty()) averageFrameBytes = bytes / static_cast<int64_t>(chunk->frames.size());
+			chunkCount++;
+			decodedCount += decoded;
+			keptCount += static_cast<int>(chunk->frames.size());
+			decodeSeconds += Utility::GetTime() - decodeStart;
+		}
+	}
+	else
+	{
+		failedWorkerCount++;
+	}
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+	avcodec_free_context(&codecContext);
+	if (container) avformat_close_input(&container);
+}
+
+int ReverseDecoder::DecodeChunk(AVFormatContext* container, AVCodecContext* codecContext, AVPacket* packet, AVFrame* frame,
+	const Chunk& chunk, std::vector<ReverseFrame>& frames)
+{
+	if (av_seek_frame(container, streamIndex, chunk.seekTimestamp, AVSEEK_FLAG_BACKWARD) < 0) return 0;
+	avcodec_flush_buffers(codecContext);
+	double streamTimeBase = av_q2d(container->streams[streamIndex]->time_base);
+	int decoded = 0;
+	bool isEOF = false, isDone = false;
+	while (!isDone && !isEOF && !isStopRequested)
+	{
+		int errVal = av_read_frame(container, packet);
+		if (errVal == AVERROR(EAGAIN)) continue;
+		if (errVal < 0)
+		{
+			//Drains the frames still inside the decoder.
+			isEOF = true;
+			avcodec_send_packet(codecContext, NULL);
+		}
+		else if (packet->stream_index != streamIndex)
+		{
+			av_packet_unref(packet);
+			continue;
+		}
+		else
+		{
+			//Frames before the chunk that nothing refers to don't need decoding at all.
+			bool isBeforeChunk = packet->pts != AV_NOPTS_VALUE && packet->pts * streamTimeBase < chunk.start;
+			codecContext->skip_frame = isBeforeChunk ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+			avcodec_send_packet(codecContext, packet);
+			av_packet_unref(packet);
+		}
+
+		while (avcodec_receive_frame(codecContext, frame) == 0)
+		{
+			decoded++;
+			int64_t timestamp = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+			double pts = timestamp * streamTimeBase;
+			//Frames come out in pts order, so everything in the chunk has been decoded.
+			if (timestamp != AV_NOPTS_VALUE && pts >= chunk.end)
+			{
+				av_frame_unref(frame);
+				isDone = true;
+				break;
+			}
+			if (timestamp != AV_NOPTS_VALUE && pts >= chunk.start)
+			{
+				ReverseFrame kept{};
+				//Takes over the decoder's buffers, nothing is copied.
+				kept.frame = av_frame_clone(frame);
+				if (kept.frame)
+				{
+					kept.pts = pts;
+					kept.duration = frame->pkt_duration > 0 ? frame->pkt_duration * streamTimeBase : frameInterval;
+					kept.bytes = FrameCache::GetFrameBytes(kept.frame);
+					frames.push_back(kept);
+				}
+			}
+			av_frame_unref(frame);
+		}
+	}
+	return decoded;
+}
+
+void ReverseDecoder::PlanChunks()
+{
+	//The chunk being shown, and one being decoded ahead by each worker.
+	while (isPlanning && static_cast<int>(chunks.size()) < config.workerCount + 1)
+	{
+		std::unique_ptr<Chunk> chunk = std::make_unique<Chunk>();
+		chunk->end = planEnd;
+		//As many frames as fit in chunkBytes.
+		double maxSeconds = static_cast<double>(config.chunkBytes) / averageFrameBytes * frameInterval;
+		if (maxSeconds < 2 * frameInterval) maxSeconds = 2 * frameInterval;
+		chunk->start = planEnd - maxSeconds;
+		//Without an index, the container finds the keyframe before the start itself.
+		chunk->seekTimestamp = static_cast<int64_t>(chunk->start / av_q2d(timeBase));
+		//Keyframe the frames before planEnd are decoded from. Only the rest of its GOP if that fits, so no frame is decoded twice.
+		KeyframeEntry keyframe{};
+		if (keyframeIndex && keyframeIndex->Find(planEnd - frameInterval / 2, keyframe))
+		{
+			double keyframeSeconds = keyframeIndex->GetSeconds(keyframe);
+			if (keyframeSeconds > chunk->start) chunk->start = keyframeSeconds;
+			chunk->seekTimestamp = keyframe.pts;
+		}
+		if (chunk->start <= streamStartSeconds)
+		{
+			//Everything up to the start of the video.
+			chunk->start = std::numeric_limits<double>::lowest();
+			chunk->seekTimestamp = static_cast<int64_t>(streamStartSeconds / av_q2d(timeBase));
+			chunk->isFirst = true;
+			isPlanning = false;
+		}
+		planEnd = chunk->start;
+		chunks.push_back(std::move(chunk));
+		chunkPlanned.notify_all();
+	}
+}
+
+void ReverseDecoder::PopChunk()
+{
+	for (ReverseFrame& reverseFrame : chunks.front()->frames) FreeFrame(reverseFrame);
+	chunks.pop_front();
+}
+
+void ReverseDecoder::FreeFrame(ReverseFrame& reverseFrame)
+{
+	heldBytes -= reverseFrame.bytes;
+	av_frame_free(&reverseFrame.frame);
+}
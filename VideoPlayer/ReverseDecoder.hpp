@@ -0,0 +1,146 @@
+/*
+	File Name: ReverseDecoder.hpp
+
+	Brief: Declares ReverseDecoder, which decodes the video backwards for reverse playback.
+	The video is split into chunks(a GOP, or part of one if it's too big), each decoded forwards from its keyframe on a worker thread,
+	so their frames can be shown in reverse. Chunks before the one being shown are decoded ahead of time.
+*/
+
+#ifndef REVERSEDECODER_HPP
+#define REVERSEDECODER_HPP
+#include "types.hpp"
+#include "KeyframeIndex.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <ostream>
+
+//How much a ReverseDecoder decodes ahead, and with how much memory.
+struct ReverseConfig
+{
+	//Chunks decoded at once, each with its own container and decoder. As many chunks are decoded ahead of the one being shown.
+	int workerCount = 2;
+	//Bytes of decoded frames a chunk may hold. GOPs bigger than this are split, each part decoded from the GOP's keyframe.
+	int64_t chunkBytes = 256 * 1024 * 1024;
+};
+
+/*
+	Opens its own containers, so it never touches the ones being played.
+	Only one thread may call GetFrame.
+*/
+class ReverseDecoder
+{
+public:
+	/*
+		Starts decoding the chunks before startSeconds.
+		stream --> Video stream to decode, in the player's container. Only read here.
+		keyframeIndex --> Lines chunks up with GOPs, may be null or incomplete. Must outlive the ReverseDecoder.
+	*/
+	ReverseDecoder(const std::string& fileName, const AVStream* stream, const KeyframeIndex* keyframeIndex, double startSeconds,
+		const ReverseConfig& config = ReverseConfig{});
+	//Stops and joins the workers.
+	~ReverseDecoder();
+
+	ReverseDecoder(const ReverseDecoder& toCopy) = delete;
+	ReverseDecoder& operator=(const ReverseDecoder& rhs) = delete;
+
+	/*
+		References the frame showing at seconds into output(which the caller owns). pts/duration --> Set to the frame's.
+		Frames after seconds are freed, as playing backwards never needs them again.
+		Returns false if it isn't decoded yet.
+	*/
+	bool GetFrame(double seconds, AVFrame* output, double& pts, double& duration);
+	//True once the first frame of the video has been returned, there's nothing before it.
+	bool IsAtStart() const { return isAtStart; }
+	//True if no worker could open the file, so nothing will ever be decoded.
+	bool IsFailed() const { return failedWorkerCount == config.workerCount; }
+
+	//Frames decoded for each frame kept, decode rate, memory held and stalls.
+	void PrintStats(std::ostream& output) const;
+	//Highest number of bytes of decoded frames held at once.
+	int64_t GetPeakBytes() const;
+
+private:
+	struct ReverseFrame
+	{
+		AVFrame* frame = nullptr;
+		double pts = 0, duration = 0;
+		int64_t bytes = 0;
+	};
+	enum class ChunkState
+	{
+		PENDING = 0,
+		DECODING,
+		DONE,
+	};
+	//Frames with start <= pts < end, decoded from the keyframe at seekTimestamp.
+	struct Chunk
+	{
+		double start = 0, end = 0;
+		int64_t seekTimestamp = 0; //In the stream's time base.
+		bool isFirst = false; //Reaches the start of the video.
+		ChunkState state = ChunkState::PENDING;
+		std::vector<ReverseFrame> frames{}; //Sorted by pts, once DONE.
+	};
+
+	//Worker thread's loop. Decodes pending chunks, nearest to the one being shown first.
+	void Work();
+	//Decodes the chunk's frames into frames. Returns the number of frames decoded, kept or not.
+	int DecodeChunk(AVFormatContext* container, AVCodecContext* codecContext, AVPacket* packet, AVFrame* frame,
+		const Chunk& chunk, std::vector<ReverseFrame>& frames);
+	//Plans chunks before the last one until enough are being decoded ahead. Requires lock on mutex.
+	void PlanChunks();
+	//Frees the front chunk's frames and removes it. Requires lock on mutex.
+	void PopChunk();
+	void FreeFrame(ReverseFrame& reverseFrame);
+
+	std::string fileName;
+	int streamIndex;
+	AVCodecParameters* codecParameters = nullptr; //Copy of the player's. Need to alloc and dealloc.
+	AVRational timeBase;
+	//Seconds of the stream's first frame, the chunk reaching it is the last one.
+	double streamStartSeconds = 0;
+	//For frames with no duration, and to size chunks.
+	double frameInterval;
+	const KeyframeIndex* keyframeIndex;
+	ReverseConfig config;
+	//Decode threads each worker's decoder gets, so the workers together use every core.
+	int threadsPerWorker = 1;
+
+	//Guards everything below.
+	mutable std::mutex mutex{};
+	//Signalled when a chunk is planned, or the workers are told to stop.
+	std::condition_variable chunkPlanned{};
+	//Latest first, the front one is being shown.
+	std::deque<std::unique_ptr<Chunk>> chunks{};
+	//Where the next chunk planned ends.
+	double planEnd = 0;
+	//False once the chunk reaching the start of the video is planned.
+	bool isPlanning = true;
+	//Measured from chunks decoded, so long GOPs are split to fit chunkBytes.
+	int64_t averageFrameBytes = 0;
+	int64_t heldBytes = 0, peakBytes = 0;
+
+	std::vector<std::thread> workers{};
+	std::atomic<bool> isStopRequested{ false };
+	std::atomic<int> failedWorkerCount{ 0 };
+	std::atomic<bool> isAtStart{ false };
+
+	//=======Stats
+	int chunkCount = 0, decodedCount = 0, keptCount = 0;
+	//Different frames GetFrame has returned.
+	int shownCount = 0;
+	double lastShownPts = -1;
+	double decodeSeconds = 0;
+	//Times GetFrame had nothing to give, and for how long in total.
+	int stallCount = 0;
+	double stallSeconds = 0, stallStart = 0;
+	bool isStalled = false;
+};
+
+#endif
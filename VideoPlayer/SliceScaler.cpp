@@ -0,0 +1,289 @@
+/*
+	File Name: SliceScaler.cpp
+
+	Brief: Defines SliceScaler, which resizes/converts frames with sws_scale split into horizontal bands,
+	each band scaled in parallel on a pool of worker threads with its own scaler context.
+*/
+
+#include "SliceScaler.hpp"
+#include <cmath>
+
+namespace
+{
+	int GreatestCommonDivisor(int a, int b)
+	{
+		while (b != 0)
+		{
+			int remainder = a % b;
+			a = b;
+			b = remainder;
+		}
+		return a;
+	}
+
+	//Rows of that plane for the given luma rows.
+	int PlaneRows(const AVPixFmtDescriptor* desc, int plane, int rows)
+	{
+		//Only the chroma planes are subsampled, alpha(plane 3) is full size.
+		if (plane != 1 && plane != 2) return rows;
+		return -((-rows) >> desc->log2_chroma_h); //Rounds up.
+	}
+
+	//Formats that can't be cut into bands by offsetting plane pointers.
+	bool IsSliceable(const AVPixFmtDescriptor* desc)
+	{
+		return desc && !(desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL));
+	}
+}
+
+SliceScaler::SliceScaler(int threadCount)
+{
+	if (threadCount <= 0) threadCount = static_cast<int>(std::thread::hardware_concurrency());
+	this->threadCount = threadCount > 0 ? threadCount : 1;
+	//Thread calling Scale works too, so one less worker.
+	for (int i = 1; i < this->threadCount; i++)
+	{
+		workers.emplace_back(&SliceScaler::WorkerLoop, this);
+	}
+}
+
+SliceScaler::~SliceScaler()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		isStopRequested = true;
+	}
+	jobReady.notify_all();
+	for (std::thread& worker : workers)
+	{
+		if (worker.joinable()) worker.join();
+	}
+	FreeBands();
+}
+
+bool SliceScaler::Configure(int srcWidth, int srcHeight, AVPixelFormat srcFormat, int dstWidth, int dstHeight, AVPixelFormat dstFormat, int flags)
+{
+	if (isConfigured && this->srcWidth == srcWidth && this->srcHeight == srcHeight && this->srcFormat == srcFormat
+		&& this->dstWidth == dstWidth && this->dstHeight == dstHeight && this->dstFormat == dstFormat && this->flags == flags)
+	{
+		return true;
+	}
+	FreeBands();
+	isConfigured = false;
+	if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) return false;
+	this->srcWidth = srcWidth;
+	this->srcHeight = srcHeight;
+	this->srcFormat = srcFormat;
+	this->dstWidth = dstWidth;
+	this->dstHeight = dstHeight;
+	this->dstFormat = dstFormat;
+	this->flags = flags;
+	if (!CreateBands())
+	{
+		FreeBands();
+		return false;
+	}
+	isConfigured = true;
+	return true;
+}
+
+bool SliceScaler::CreateBands()
+{
+	const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+	const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+
+	//Smallest run of rows where source and destination line up exactly, and chroma rows aren't split.
+	int divisor = GreatestCommonDivisor(srcHeight, dstHeight);
+	int srcUnit = srcHeight / divisor, dstUnit = dstHeight / divisor;
+	if (srcDesc && dstDesc)
+	{
+		while (dstUnit <= dstHeight && (srcUnit % (1 << srcDesc->log2_chroma_h) || dstUnit % (1 << dstDesc->log2_chroma_h)))
+		{
+			srcUnit *= 2;
+			dstUnit *= 2;
+		}
+	}
+	int unitCount = dstUnit <= dstHeight ? dstHeight / dstUnit : 0;
+
+	int bandCount = threadCount;
+	if (bandCount > dstHeight / minBandHeight) bandCount = dstHeight / minBandHeight;
+	if (bandCount > unitCount) bandCount = unitCount;
+	if (!IsSliceable(srcDesc) || !IsSliceable(dstDesc)) bandCount = 1;
+	if (bandCount < 1) bandCount = 1;
+
+	if (bandCount == 1)
+	{
+		Band band{};
+		band.srcHeight = srcHeight;
+		band.dstHeight = dstHeight;
+		band.ownHeight = dstHeight;
+		band.context = sws_getContext(srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, dstFormat, flags, NULL, NULL, NULL);
+		bands.push_back(band);
+		return band.context != nullptr;
+	}
+
+	//Source rows the vertical filter may reach past a band's edge. Generous, to cover the widest(bicubic/lanczos) filters
+	//and the chroma planes, which reach twice as far in luma rows.
+	double ratio = static_cast<double>(srcHeight) / dstHeight;
+	double marginRows = 8 * (ratio > 1 ? ratio : 1) + 8;
+	int marginUnits = static_cast<int>(std::ceil(marginRows / srcUnit));
+
+	for (int i = 0; i < bandCount; i++)
+	{
+		int firstUnit = unitCount * i / bandCount;
+		int endUnit = unitCount * (i + 1) / bandCount;
+		bool isLast = i == bandCount - 1;
+		int topUnits = firstUnit < marginUnits ? firstUnit : marginUnits;
+		int bottomUnits = unitCount - endUnit < marginUnits ? unitCount - endUnit : marginUnits;
+
+		Band band{};
+		band.ownY = firstUnit * dstUnit;
+		band.ownHeight = isLast ? dstHeight - band.ownY : (endUnit - firstUnit) * dstUnit;
+		band.topMargin = topUnits * dstUnit;
+		band.srcY = (firstUnit - topUnits) * srcUnit;
+		band.srcHeight = (endUnit + bottomUnits - firstUnit + topUnits) * srcUnit;
+		band.dstHeight = (endUnit + bottomUnits - firstUnit + topUnits) * dstUnit;
+		//Rows left over after the last whole unit belong to the last band, in the same ratio.
+		if (isLast)
+		{
+			band.srcHeight = srcHeight - band.srcY;
+			band.dstHeight = dstHeight - (band.ownY - band.topMargin);
+		}
+
+		band.context = sws_getContext(srcWidth, band.srcHeight, srcFormat, dstWidth, band.dstHeight, dstFormat, flags, NULL, NULL, NULL);
+		if (!band.context)
+		{
+			bands.push_back(band);
+			return false;
+		}
+		if (band.dstHeight != band.ownHeight)
+		{
+			band.scratch = av_frame_alloc();
+			if (band.scratch)
+			{
+				band.scratch->format = dstFormat;
+				band.scratch->width = dstWidth;
+				band.scratch->height = band.dstHeight;
+			}
+			if (!band.scratch || av_frame_get_buffer(band.scratch, 64) < 0)
+			{
+				bands.push_back(band);
+				return false;
+			}
+		}
+		bands.push_back(band);
+	}
+	return true;
+}
+
+void SliceScaler::FreeBands()
+{
+	for (Band& band : bands)
+	{
+		sws_freeContext(band.context);
+		av_frame_free(&band.scratch);
+	}
+	bands.clear();
+}
+
+bool SliceScaler::Scale(const AVFrame* src, AVFrame* dst)
+{
+	if (!isConfigured || !src || !dst) return false;
+	if (bands.size() == 1 || workers.empty())
+	{
+		bool isSuccess = true;
+		for (Band& band : bands)
+		{
+			isSuccess = ScaleBand(band, src, dst) && isSuccess;
+		}
+		return isSuccess;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		jobSrc = src;
+		jobDst = dst;
+		isJobFailed = false;
+		bandsRemaining = static_cast<int>(bands.size());
+		//Set last, workers only start taking bands once they see it reset.
+		nextBand = 0;
+		jobGeneration++;
+	}
+	jobReady.notify_all();
+	WorkOnJob();
+
+	std::unique_lock<std::mutex> lock{ mutex };
+	jobDone.wait(lock, [this]() { return bandsRemaining == 0; });
+	return !isJobFailed;
+}
+
+void SliceScaler::WorkOnJob()
+{
+	int bandIndex;
+	while ((bandIndex = nextBand++) < static_cast<int>(bands.size()))
+	{
+		if (!ScaleBand(bands[bandIndex], jobSrc, jobDst)) isJobFailed = true;
+		if (--bandsRemaining == 0)
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			jobDone.notify_all();
+		}
+	}
+}
+
+void SliceScaler::WorkerLoop()
+{
+	unsigned int seenGeneration = 0;
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (true)
+	{
+		jobReady.wait(lock, [&]() { return isStopRequested || jobGeneration != seenGeneration; });
+		if (isStopRequested) return;
+		seenGeneration = jobGeneration;
+		lock.unlock();
+		WorkOnJob();
+		lock.lock();
+	}
+}
+
+bool SliceScaler::ScaleBand(Band& band, const AVFrame* src, AVFrame* dst)
+{
+	const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(srcFormat);
+	const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dstFormat);
+	if (!srcDesc || !dstDesc) return false;
+
+	//Source starting from the band's first row(margin included).
+	const uint8_t* srcData[4]{};
+	for (int plane = 0; plane < 4; plane++)
+	{
+		if (!src->data[plane]) continue;
+		srcData[plane] = src->data[plane] + PlaneRows(srcDesc, plane, band.srcY) * src->linesize[plane];
+	}
+
+	if (!band.scratch)
+	{
+		//No margins, write straight into the band's rows.
+		uint8_t* dstData[4]{};
+		for (int plane = 0; plane < 4; plane++)
+		{
+			if (!dst->data[plane]) continue;
+			dstData[plane] = dst->data[plane] + PlaneRows(dstDesc, plane, band.ownY) * dst->linesize[plane];
+		}
+		return sws_scale(band.context, srcData, src->linesize, 0, band.srcHeight, dstData, dst->linesize) > 0;
+	}
+
+	if (sws_scale(band.context, srcData, src->linesize, 0, band.srcHeight, band.scratch->data, band.scratch->linesize) <= 0) return false;
+	//Copy only the band's own rows out, margins were only there for the filter.
+	for (int plane = 0; plane < 4 && dst->data[plane]; plane++)
+	{
+		int firstRow = PlaneRows(dstDesc, plane, band.ownY);
+		int rows = PlaneRows(dstDesc, plane, band.ownY + band.ownHeight) - firstRow;
+		int marginRows = PlaneRows(dstDesc, plane, band.topMargin);
+		int bytes = av_image_get_linesize(dstFormat, dstWidth, plane);
+		if (bytes <= 0) continue;
+		av_image_copy_plane(dst->data[plane] + firstRow * dst->linesize[plane], dst->linesize[plane],
+			band.scratch->data[plane] + marginRows * band.scratch->linesize[plane], band.scratch->linesize[plane],
+			bytes, rows);
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+/*
+	File Name: SliceScaler.hpp
+
+	Brief: Declares SliceScaler, which resizes/converts frames with sws_scale split into horizontal bands,
+	each band scaled in parallel on a pool of worker threads with its own scaler context.
+*/
+
+#ifndef SLICESCALER_HPP
+#define SLICESCALER_HPP
+#include "types.hpp"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/*
+	Bands are cut on rows where the source and destination line up exactly(multiples of their gcd),
+	so each band's scaler context sees the same scale ratio as the whole frame would.
+	Each band is also given extra source rows above and below(margins), so the vertical filter has the same rows to work with
+	as it would scaling the whole frame. Margin output is thrown away.
+
+	Not thread safe, only one thread should call Configure/Scale.
+*/
+class SliceScaler
+{
+public:
+	//threadCount --> Threads to scale bands on(including the one calling Scale), 0 for one per core.
+	SliceScaler(int threadCount = 0);
+	~SliceScaler();
+
+	SliceScaler(const SliceScaler& toCopy) = delete;
+	SliceScaler& operator=(const SliceScaler& rhs) = delete;
+
+	/*
+		Sets up scaler contexts for that conversion. Does nothing if it's already set up for it.
+		flags --> sws flags, e.g. SWS_BICUBIC.
+		Returns false if unable to.
+	*/
+	bool Configure(int srcWidth, int srcHeight, AVPixelFormat srcFormat, int dstWidth, int dstHeight, AVPixelFormat dstFormat, int flags);
+	/*
+		Scales src into dst, which must already have buffers for the configured output.
+		Returns once every band is done. Returns false if unable to.
+	*/
+	bool Scale(const AVFrame* src, AVFrame* dst);
+
+	int GetBandCount() const { return static_cast<int>(bands.size()); }
+	int GetThreadCount() const { return threadCount; }
+
+	//Bands aren't made shorter than this many destination rows, as small bands spend more time on margins than their own rows.
+	static const int minBandHeight = 64;
+
+private:
+	struct Band
+	{
+		SwsContext* context = nullptr;
+		//Source rows given to context, margins included.
+		int srcY = 0, srcHeight = 0;
+		//Destination rows context outputs, margins included.
+		int dstHeight = 0;
+		//Output rows above the band's own rows, thrown away.
+		int topMargin = 0;
+		//Band's own rows in the destination.
+		int ownY = 0, ownHeight = 0;
+		//Output goes here first if the band has margins, then its own rows are copied out. nullptr to write straight to the destination.
+		AVFrame* scratch = nullptr;
+	};
+
+	//Splits the frame into bands, creating their contexts. Returns false if unable to.
+	bool CreateBands();
+	void FreeBands();
+	bool ScaleBand(Band& band, const AVFrame* src, AVFrame* dst);
+	//Takes bands off the current job until there are none left. Run by the workers and the thread calling Scale.
+	void WorkOnJob();
+	void WorkerLoop();
+
+	int threadCount = 1;
+	std::vector<Band> bands{};
+	std::vector<std::thread> workers{};
+
+	//Configured conversion.
+	bool isConfigured = false;
+	int srcWidth = 0, srcHeight = 0, dstWidth = 0, dstHeight = 0, flags = 0;
+	AVPixelFormat srcFormat = AV_PIX_FMT_NONE, dstFormat = AV_PIX_FMT_NONE;
+
+	//Current job, shared with the workers.
+	std::mutex mutex{};
+	std::condition_variable jobReady{}, jobDone{};
+	unsigned int jobGeneration = 0; //Goes up every job, so workers know there's a new one.
+	const AVFrame* jobSrc = nullptr;
+	AVFrame* jobDst = nullptr;
+	std::atomic<int> nextBand{ 0 };
+	std::atomic<int> bandsRemaining{ 0 };
+	std::atomic<bool> isJobFailed{ false };
+	bool isStopRequested = false;
+};
+
+#endif
@@ -19,9 +19,20 @@ namespace Utility
 	void UpdateDeltaTime()
 	{
 		//Stores time of last frame, and compares difference with time of current frame.
-		static std::chrono::system_clock::time_point lastCalledTime = std::chrono::system_clock::now();
-		std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - lastCalledTime;
-		lastCalledTime = std::chrono::system_clock::now();
+		//Steady clock, as system_clock jumps with system time adjustments.
+		static std::chrono::steady_clock::time_point lastCalledTime = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = now - lastCalledTime;
+		lastCalledTime = now;
 		deltaTime = elapsed_seconds.count();
 	}
+
+	/*
+		Seconds from a monotonic clock, which doesn't jump with system time adjustments.
+	*/
+	double GetTime()
+	{
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now().time_since_epoch();
+		return seconds.count();
+	}
 }
@@ -21,6 +21,12 @@ namespace Utility
 		Updates deltaTime.
 	*/
 	void UpdateDeltaTime();
+
+	/*
+		Seconds from a monotonic clock, which doesn't jump with system time adjustments.
+		Only useful for differences between two calls.
+	*/
+	double GetTime();
 }
 
 #endif
\ No newline at end of file
@@ -14,20 +14,77 @@
 #include "Video.hpp"
 #include "Display.hpp"
 #include "Utility.hpp"
+#include "Windows.hpp"
+#include "PixelConvert.hpp"
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <cmath>
 
 void* buffer_to_free = nullptr;
-//If it's seeked backwards(0 for video, 1 for audio stream) then it ignores the current stream timestamp and gets the frame(even if current timestamp > video_time) in order to update to the new(lower) timestamp.
-bool isSeekedBackwards[2]; 
 
 /*---------------------------
 VideoPlayer class variables*/
 std::string VideoPlayer::video_filepath;
 VideoFile* VideoPlayer::video_file;
+DecoderConfig VideoPlayer::decoder_config;
+OpenConfig VideoPlayer::open_config;
+double VideoPlayer::open_start_time;
+double VideoPlayer::time_to_first_frame;
+double VideoPlayer::seek_request_time;
+double VideoPlayer::seek_target_time;
+int VideoPlayer::seek_serial;
+bool VideoPlayer::isSeekMeasurePending;
+bool VideoPlayer::isSeekHolding;
+std::atomic<int> VideoPlayer::video_ended_serial;
+bool VideoPlayer::isUserPaused;
+SeekStats VideoPlayer::seek_stats;
 bool VideoPlayer::isRun_Video;
-double VideoPlayer::curr_video_time;
+std::atomic<double> VideoPlayer::curr_video_time;
+std::atomic<ClockMaster> VideoPlayer::clock_master;
+Clock VideoPlayer::audio_clock;
+Clock VideoPlayer::video_clock;
+Clock VideoPlayer::external_clock;
+ClockPublisher VideoPlayer::audio_clock_publisher;
+double VideoPlayer::audio_device_latency;
 int VideoPlayer::audio_stream_index, VideoPlayer::video_stream_index;
-AVFrame** VideoPlayer::next_audio_frame, ** VideoPlayer::next_video_frame;
+FrameQueue* VideoPlayer::video_frame_queue;
+double VideoPlayer::video_frame_interval;
+FrameCache* VideoPlayer::video_frame_cache;
+int64_t VideoPlayer::frame_cache_budget = FrameCache::defaultBudgetBytes;
+std::atomic<bool> VideoPlayer::isFrameCacheFilling;
+AVFrame* VideoPlayer::step_frame;
+double VideoPlayer::displayed_pts, VideoPlayer::displayed_duration;
+bool VideoPlayer::isStepped;
+ReverseDecoder* VideoPlayer::reverse_decoder;
+ReverseConfig VideoPlayer::reverse_config;
+double VideoPlayer::reverse_speed;
+double VideoPlayer::reverse_pts, VideoPlayer::reverse_time;
+bool VideoPlayer::isReverseStalled;
+std::thread VideoPlayer::video_decode_thread;
+std::atomic<bool> VideoPlayer::isRun_VideoDecode;
+FrameScheduler VideoPlayer::video_scheduler;
+QualityGovernor VideoPlayer::video_governor;
+double VideoPlayer::cpu_seconds_at_start;
+UploadMode VideoPlayer::upload_mode;
+int VideoPlayer::lock_converter_format;
+PixelConvert::Converter VideoPlayer::lock_converter;
+SliceScaler* VideoPlayer::lock_scaler;
+AudioRingBuffer* VideoPlayer::audio_ring_buffer;
+std::thread VideoPlayer::audio_decode_thread;
+std::atomic<bool> VideoPlayer::isRun_AudioDecode;
+std::atomic<bool> VideoPlayer::isAudioFlushRequested;
+std::atomic<double> VideoPlayer::audio_ring_end_pts;
+std::atomic<int> VideoPlayer::audio_ring_serial;
+double VideoPlayer::audio_bytes_per_second;
+std::atomic<int> VideoPlayer::audio_underrun_count;
+SwrContext* VideoPlayer::audio_resampler;
+int VideoPlayer::resampler_in_format;
+int64_t VideoPlayer::resampler_in_layout;
+int VideoPlayer::resampler_in_rate;
+AVSampleFormat VideoPlayer::audio_device_sample_format;
+int VideoPlayer::audio_bytes_per_sample_frame;
 SDL_AudioSpec VideoPlayer::audio_device_specs;
 SDL_AudioDeviceID VideoPlayer::audio_device;
 
@@ -36,11 +93,20 @@ bool VideoPlayer::Initialize(std::string video_filepath)
 	//If initialization is unsuccessful, it indicates to not run VideoPlayer::Update and Draw loop.
 	//If successful, set it to true at the end.
 	isRun_Video = false;
-	isSeekedBackwards[0] = false; isSeekedBackwards[1] = false;
+	audio_ring_end_pts = 0;
+	audio_ring_serial = 0;
+	audio_underrun_count = 0;
+	isAudioFlushRequested = false;
 	//=======Initialize video file.
 	VideoPlayer::video_filepath = video_filepath;
-	video_file = new VideoFile{ video_filepath };
-	curr_video_time = 0.001;
+	open_start_time = Utility::GetTime();
+	time_to_first_frame = -1;
+	video_file = new VideoFile{ video_filepath, DemuxConfig{}, decoder_config, open_config };
+	curr_video_time = 0;
+	audio_clock = Clock{};
+	video_clock = Clock{};
+	external_clock = Clock{};
+	audio_clock_publisher.Publish(0, Utility::GetTime(), -1); //Nothing played yet, ignored as no seek has that serial.
 	//=======Check if video_file is successfully created.
 	const VideoFileError* errorChecker;
 	if (errorChecker = video_file->checkIsValid())
@@ -63,6 +129,9 @@ bool VideoPlayer::Initialize(std::string video_filepath)
 		return false;
 	}
 
+	//Shows what each decoder was opened with, e.g. its threading.
+	video_file->PrintDetails(std::cout);
+
 	//====Check which audio/video streams are available. It's fine to continue running even if one of them is missing.
 	video_stream_index = video_file->GetVideoStreamIndex();
 	audio_stream_index = video_file->GetAudioStreamIndex();
@@ -80,255 +149,574 @@ bool VideoPlayer::Initialize(std::string video_filepath)
 	//=========Initializing other aspects
 	//Constraints video display dimensions to aspect ratio of the video.
 	DisplayWindow::LimitVideoDisplayRect_to_Video(video_file);
+	//Decodes at a lower resolution if the video is shown much smaller than it is.
+	SDL_Rect display_rect = DisplayWindow::GetVideoDimensions();
+	video_file->SetTargetDimensions(display_rect.w, display_rect.h);
 
 
 	//Initialize output audio device to output in desired format.
 	//Needs to be runned once at the start, to enable AudioCallback to start taking in audio input continuously
 	InitializeAudioDevice(video_file->GetStreamData(audio_stream_index).codecContext);
+	//Audio is the master if there is any, as skipping/repeating video frames is less noticeable than gaps in audio.
+	SetClockMaster(ClockMaster::AUDIO);
+	audio_clock.Set(0);
+	video_clock.Set(0);
+	external_clock.Set(0);
+
+	//Start decoding video frames ahead of when they're needed.
+	if (video_stream_index != -1)
+	{
+		video_scheduler.ResetStats();
+		seek_stats = SeekStats{};
+		isSeekMeasurePending = false;
+		isSeekHolding = false;
+		video_ended_serial = -1;
+		isUserPaused = false;
+		video_governor.Reset();
+		video_file->SetMinDecodeReduction(0, false);
+		cpu_seconds_at_start = GetProcessCPUSeconds();
+		SDL_DisplayMode display_mode = DisplayWindow::GetDeviceDimensions();
+		video_scheduler.SetRefreshInterval(display_mode.refresh_rate > 0 ? 1.0 / display_mode.refresh_rate : 1.0 / 60);
+		//Resized frames are written into the queue's own buffers, which are kept and reused rather than allocated per frame.
+		//Frames drawn directly only hold a reference to the decoder's buffers, dropped when the slot is next written.
+		video_frame_queue = new FrameQueue{ video_frame_queue_size, true };
+		upload_mode = DisplayWindow::GetUploadMode();
+		lock_converter_format = AV_PIX_FMT_NONE;
+		lock_converter = nullptr;
+		//Also draws cached frames in UploadMode::UPDATE, as those are kept as they came out of the decoder.
+		lock_scaler = new SliceScaler{};
+		AVStream* video_stream = video_file->GetStreamData(video_stream_index).stream;
+		video_frame_interval = video_stream->avg_frame_rate.num > 0 ? av_q2d(av_inv_q(video_stream->avg_frame_rate)) : 1.0 / 30;
+		if (frame_cache_budget > 0) video_frame_cache = new FrameCache{ frame_cache_budget };
+		isFrameCacheFilling = false;
+		step_frame = av_frame_alloc();
+		displayed_pts = 0;
+		displayed_duration = video_frame_interval;
+		isStepped = false;
+		reverse_speed = 0;
+		isRun_VideoDecode = true;
+		video_decode_thread = std::thread{ VideoPlayer::VideoDecodeLoop };
+	}
 
 	isRun_Video = true;
 	return true;
 }
 void VideoPlayer::Update()
 {
-	double stream_timestamp = 0;
-	int num_retries = 2;
-	//Used to resize the video to fit within program window.
-	SDL_Rect video_dimensions = DisplayWindow::GetVideoDimensions();
+	//Video frames are decoded on the video decode thread, only the time needs updating here.
 
-	//Playing video stream, check if it has a video stream first.
-	if (video_stream_index != -1)
+	//Reverse playback keeps its own position, see DrawReverse.
+	if (reverse_decoder) return;
+
+	//Time stays at the seek target until its first frame is shown. Gives up if it takes too long, or the seek landed past the last frame.
+	if (isSeekHolding)
 	{
-		num_retries = 2;
-		//Get the stream timestamp to compare to the actual video timestamp.
-		stream_timestamp = video_file->GetCurrentPTSTIME(CodecType::VIDEOCODEC);
-		//Get the next frame when it's time.
-		if (stream_timestamp < curr_video_time || isSeekedBackwards[0])
+		if (Utility::GetTime() - seek_request_time < seek_hold_timeout && video_ended_serial < seek_serial)
 		{
-			next_video_frame = video_file->GetFrame(CodecType::VIDEOCODEC);
-			//It may fail sometimes, retry for X num of times before giving up.
-			while (num_retries-- && next_video_frame == nullptr)
-			{
-				next_video_frame = video_file->GetFrame(CodecType::VIDEOCODEC);
-			}
-			if (next_video_frame)
-			{
-				isSeekedBackwards[0] = false;
-				video_file->ResizeVideoFrame(*next_video_frame, video_dimensions.w, video_dimensions.h);
-			}
+			curr_video_time = seek_target_time;
+			return;
 		}
+		ReleaseSeekHold(seek_target_time);
 	}
 
-
-
-	//Every frame, update the new time.
-	//Sync up with the slowest stream or sync up with audio stream, choose one.
-	if (audio_stream_index != -1 && video_stream_index != -1)
+	//Audio time from before a seek is ignored, the clock was already moved to the new position by SeekVideo.
+	double audio_pts, audio_time;
+	int audio_serial;
+	if (audio_clock_publisher.Read(audio_pts, audio_time, audio_serial) && audio_serial == video_file->GetSerial())
 	{
-		double audio_stream_time = video_file->GetCurrentPTSTIME(CodecType::AUDIOCODEC);
-		double video_stream_time = video_file->GetCurrentPTSTIME(CodecType::VIDEOCODEC);
-		//Make sure curr_video_time doesn't get reset to 0 if cannot read a frame.
-		if (audio_stream_time != 0 && video_stream_time != 0)
-		{
-			curr_video_time = (audio_stream_time < video_stream_time) ? audio_stream_time : video_stream_time;
-		}
-		std::cout << "Audio: " << audio_stream_time << " | Video: " << video_stream_time << " | TOTAL: " << curr_video_time << "\n";
-		//curr_video_time = audio_stream_time;
+		audio_clock.Sync(audio_pts, audio_time);
 	}
-	//This can be changed to make the video run faster or slower.
-	curr_video_time += 2 * Utility::deltaTime;
+
+	//Every frame, update the new time from the master clock.
+	curr_video_time = GetMasterTime();
 }
 void VideoPlayer::Draw()
 {
-	if (next_video_frame)
+	if (reverse_decoder)
 	{
-		DisplayWindow::DrawAVFrame(next_video_frame);
+		DrawReverse();
+		return;
 	}
-	else
+	//Only uploads and presents when a new frame is due. The window keeps showing the last one until then.
+	QueuedFrame* queued_frame = nullptr;
+	while (video_frame_queue && (queued_frame = video_frame_queue->Peek()) != nullptr)
 	{
-		const VideoFileError* err = video_file->checkIsValid();
-		if (err)
+		//Frame is from before a seek, throw it away. While holding, that includes a seek the demuxer hasn't done yet.
+		if (queued_frame->serial != video_file->GetSerial() || (isSeekHolding && queued_frame->serial < seek_serial))
 		{
-			std::cout << err->message;
-			video_file->ResetErrorCodes();
+			video_frame_queue->Pop();
+			continue;
 		}
-	}
-	if (!next_audio_frame)
-	{
-		const VideoFileError* err = video_file->checkIsValid();
-		if (err)
+		//First frame after a seek goes up straight away, and time carries on from it.
+		FrameScheduler::Action action = isSeekHolding ? FrameScheduler::Action::PRESENT
+			: video_scheduler.Schedule(*queued_frame, video_frame_queue->PeekNext(), curr_video_time);
+		//Not time for it yet.
+		if (action == FrameScheduler::Action::WAIT) break;
+		//Too late, and a later frame is already due. Skips the upload.
+		if (action == FrameScheduler::Action::DROP)
 		{
-			std::cout << err->message;
-			video_file->ResetErrorCodes();
+			video_frame_queue->Pop();
+			continue;
 		}
+		//Texture keeps its own copy, so the frame can go back to the decode thread once drawn.
+		if (upload_mode == UploadMode::LOCK) DrawLockedFrame(queued_frame->frame);
+		else DisplayWindow::DrawAVFrame(&queued_frame->frame);
+		double pts = queued_frame->pts;
+		int serial = queued_frame->serial;
+		displayed_pts = pts;
+		displayed_duration = queued_frame->duration;
+		video_clock.Set(pts);
+		//Slot goes back to the decode thread, don't touch queued_frame after this.
+		video_frame_queue->Pop();
+		if (isSeekHolding) ReleaseSeekHold(pts);
+		if (isSeekMeasurePending && serial >= seek_serial)
+		{
+			isSeekMeasurePending = false;
+			seek_stats.Record(std::abs(pts - seek_target_time), Utility::GetTime() - seek_request_time);
+		}
+		if (time_to_first_frame < 0)
+		{
+			//From starting to open the file until its first frame is on screen.
+			time_to_first_frame = Utility::GetTime() - open_start_time;
+			std::cout << "Time to first frame: " << time_to_first_frame * 1000 << " ms\n";
+		}
+		break;
+	}
+}
+
+bool VideoPlayer::DrawLockedFrame(AVFrame* frame)
+{
+	//Renderer takes it as it is, nothing to convert.
+	if (DisplayWindow::CanDrawDirectly(frame->format, frame->width, frame->height))
+	{
+		return DisplayWindow::DrawAVFrame(&frame);
+	}
+	if (frame->format != lock_converter_format)
+	{
+		lock_converter_format = frame->format;
+		lock_converter = PixelConvert::FindConverter(lock_converter_format, PixelConvert::GetI420Format(lock_converter_format));
+	}
+	//Same size, only the chroma layout/bit depth differs. The renderer scales it.
+	if (lock_converter && DisplayWindow::CanDrawDirectly(AV_PIX_FMT_YUV420P, frame->width, frame->height))
+	{
+		return DisplayWindow::DrawIntoTexture(PixelConvert::GetI420Format(frame->format), frame->width, frame->height,
+			[frame](AVFrame* texture_frame) {
+			double scale_start = Utility::GetTime();
+			bool isConverted = lock_converter(frame, texture_frame);
+			video_governor.SetScaleTime(Utility::GetTime() - scale_start);
+			return isConverted;
+		});
+	}
+	//Resized to a size the renderer takes, written straight into the texture. The renderer scales it to the window.
+	SDL_Rect video_dimensions = DisplayWindow::GetVideoTextureDimensions(frame->width, frame->height);
+	if (!lock_scaler->Configure(frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+		video_dimensions.w, video_dimensions.h, AV_PIX_FMT_YUV420P, video_governor.GetScaleFlags())) return false;
+	return DisplayWindow::DrawIntoTexture(AV_PIX_FMT_YUV420P, video_dimensions.w, video_dimensions.h,
+		[frame](AVFrame* texture_frame) {
+			double scale_start = Utility::GetTime();
+			bool isScaled = lock_scaler->Scale(frame, texture_frame);
+			video_governor.SetScaleTime(Utility::GetTime() - scale_start);
+			return isScaled;
+		});
+}
+
+void VideoPlayer::HandleWindowResize()
+{
+	DisplayWindow::HandleWindowResize();
+	if (!video_file) return;
+	//Decode resolution follows the size the video is shown at.
+	SDL_Rect display_rect = DisplayWindow::GetVideoDimensions();
+	video_file->SetTargetDimensions(display_rect.w, display_rect.h);
+}
+
+void VideoPlayer::ApplyQualityStage(QualityGovernor::Stage previous_stage)
+{
+	QualityGovernor::Stage stage = video_governor.GetStage();
+	std::cout << "Quality governor: stepped " << (stage > previous_stage ? "down" : "up") << " from "
+		<< QualityGovernor::GetStageName(previous_stage) << " to " << QualityGovernor::GetStageName(stage)
+		<< " (decode " << static_cast<int>(video_governor.GetDecodeLoad() * 100) << "%, scale "
+		<< static_cast<int>(video_governor.GetScaleLoad() * 100) << "% of frame time)\n";
+	//Scale flags and skipped frames are read from the governor every frame, only the decoder's reduction needs setting.
+	video_file->SetMinDecodeReduction(video_governor.GetMinDecodeReduction(), video_governor.IsSkipLoopFilter());
+}
+
+void VideoPlayer::Redraw()
+{
+	DisplayWindow::PresentVideoTexture();
+}
+
+int VideoPlayer::GetMillisecondsToNextFrame()
+{
+	//Audio only, nothing to draw.
+	if (!video_frame_queue) return max_idle_wait_ms;
+	if (reverse_decoder)
+	{
+		if (reverse_decoder->IsAtStart()) return max_idle_wait_ms;
+		if (isReverseStalled) return decode_wait_ms;
+		//Frame before is due once the position passes the start of the one on screen.
+		int reverse_wait_ms = static_cast<int>((GetReversePosition() - displayed_pts) / reverse_speed * 1000);
+		if (reverse_wait_ms < 0) return 0;
+		return reverse_wait_ms < max_idle_wait_ms ? reverse_wait_ms : max_idle_wait_ms;
 	}
+	QueuedFrame* queued_frame = video_frame_queue->Peek();
+	if (!queued_frame) return decode_wait_ms;
+	//Frame from before a seek, Draw needs to throw it away.
+	if (queued_frame->serial != video_file->GetSerial()) return 0;
+	//First frame after a seek is presented straight away, frames from before it are thrown away.
+	if (isSeekHolding) return 0;
+	int wait_ms = static_cast<int>(video_scheduler.GetTimeUntilDue(*queued_frame, GetMasterTime()) * 1000);
+	return wait_ms < max_idle_wait_ms ? wait_ms : max_idle_wait_ms;
 }
 void VideoPlayer::Free()
 {
 	//TODO: need to fully free everything, to be able to keep taking new videos.
-	if (video_file) delete video_file;
+	//Stop the callback and decoding before the video file is freed.
+	if (audio_device != 0)
+	{
+		SDL_CloseAudioDevice(audio_device);
+		audio_device = 0;
+	}
+	isRun_AudioDecode = false;
+	if (audio_decode_thread.joinable()) audio_decode_thread.join();
+	if (audio_ring_buffer)
+	{
+		PrintAudioStats(std::cout);
+		delete audio_ring_buffer;
+		audio_ring_buffer = nullptr;
+	}
+	swr_free(&audio_resampler);
+	isRun_VideoDecode = false;
+	if (video_decode_thread.joinable()) video_decode_thread.join();
+	//Its keyframe index belongs to video_file.
+	if (reverse_decoder)
+	{
+		reverse_decoder->PrintStats(std::cout);
+		delete reverse_decoder;
+		reverse_decoder = nullptr;
+	}
+	if (video_frame_queue)
+	{
+		video_scheduler.PrintStats(std::cout);
+		video_governor.PrintStats(std::cout);
+		if (time_to_first_frame >= 0) std::cout << "Time to first frame: " << time_to_first_frame * 1000 << " ms\n";
+		seek_stats.Print(std::cout);
+		int presented_count = video_scheduler.GetPresentedCount();
+		if (presented_count > 0)
+		{
+			std::cout << "CPU time per presented frame: "
+				<< (GetProcessCPUSeconds() - cpu_seconds_at_start) * 1000 / presented_count << " ms\n";
+		}
+		delete video_frame_queue;
+		video_frame_queue = nullptr;
+	}
+	if (video_frame_cache)
+	{
+		video_frame_cache->PrintStats(std::cout);
+		delete video_frame_cache;
+		video_frame_cache = nullptr;
+	}
+	av_frame_free(&step_frame);
+	delete lock_scaler;
+	lock_scaler = nullptr;
+	if (video_file)
+	{
+		video_file->PrintKeyframeIndexStats(std::cout);
+		//Peak depth shows how far the streams drifted apart in the file, and whether the queues stayed bounded.
+		video_file->PrintPacketQueueStats(std::cout);
+		//Should only go up when the output size changes, one per queued frame.
+		std::cout << "Resize buffer allocations: " << video_file->GetResizeAllocationCount() << "\n";
+		delete video_file;
+		video_file = nullptr;
+	}
 }
 
 /*
-	Write data in AVFrame to the buffer.
-	If data written does not == buffer_length, then get more data to write.
-	If there's excess data in AVFrame, then store it temporarily and wait for the next callback to put it in.
+	Runs on its own thread, decoding video frames and resizing them to fit the window, ahead of when they're drawn.
+	Waits while video_frame_queue is full.
+*/
+void VideoPlayer::VideoDecodeLoop()
+{
+	AVStream* video_stream = video_file->GetStreamData(video_stream_index).stream;
+	double time_base = av_q2d(video_stream->time_base);
+	//Specialized converter for the stream's format, only looked up again if the format changes.
+	int converter_format = AV_PIX_FMT_NONE;
+	PixelConvert::Converter converter = nullptr;
+	while (isRun_VideoDecode)
+	{
+		QueuedFrame* queued_frame = video_frame_queue->PeekWritable();
+		if (!queued_frame)
+		{
+			//Enough frames ready, wait for Draw to use some.
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
+		}
+
+		AVFrame** decoded_frame = video_file->GetFrame(CodecType::VIDEOCODEC);
+		//Only the decoding itself, waiting on an empty packet queue(e.g. slow I/O) isn't the decoder falling behind.
+		double decode_seconds = video_file->GetDecodeSeconds(CodecType::VIDEOCODEC);
+		if (!decoded_frame)
+		{
+			if (video_file->IsEnded(CodecType::VIDEOCODEC)) video_ended_serial = video_file->GetCodecSerial(CodecType::VIDEOCODEC);
+			const VideoFileError* err = video_file->checkIsValid(CodecType::VIDEOCODEC);
+			if (err)
+			{
+				std::cout << err->message;
+				video_file->ResetErrorCodes(CodecType::VIDEOCODEC);
+			}
+			continue;
+		}
+
+		double pts = video_file->GetCurrentPTSTIME(CodecType::VIDEOCODEC);
+		//Many streams(e.g. MKV, TS, raw) give no duration, so those frames are taken to last the stream's frame interval.
+		//Otherwise every frame would count as late the moment the clock passed its pts, and the governor would have nothing to time against.
+		double duration = (*decoded_frame)->pkt_duration * time_base;
+		if (duration <= 0) duration = video_frame_interval;
+		int serial = video_file->GetCodecSerial(CodecType::VIDEOCODEC);
+		QualityGovernor::Stage previous_stage = video_governor.GetStage();
+		if (video_governor.Update(decode_seconds, duration)) ApplyQualityStage(previous_stage);
+		//While paused every decoded frame is kept, including the ones thrown away below(e.g. decoding up to a frame stepped back to),
+		//so stepping back over them doesn't decode them again.
+		if (video_frame_cache && isFrameCacheFilling) video_frame_cache->Insert(*decoded_frame, pts, duration);
+		//Frames from before a seek are thrown away by Draw, so they aren't timed against the new position.
+		if (serial == video_file->GetSerial())
+		{
+			//Far behind, so stop decoding frames nothing refers to until caught up.
+			//The governor may also be skipping them to keep up, whichever skips more wins.
+			AVDiscard skip_frame = video_scheduler.GetSkipFrame(pts, curr_video_time);
+			if (video_governor.GetSkipFrame() > skip_frame) skip_frame = video_governor.GetSkipFrame();
+			video_file->SetSkipFrame(CodecType::VIDEOCODEC, skip_frame);
+			//Between the keyframe a seek landed on and the time it was for, only decoded so the frames after it can be.
+			double seek_target = video_file->GetSeekTarget(CodecType::VIDEOCODEC);
+			if (seek_target >= 0 && pts + duration <= seek_target) continue;
+			//Already late, don't bother resizing it.
+			if (video_scheduler.DropDecoded(pts, duration, curr_video_time)) continue;
+		}
+
+		if ((*decoded_frame)->format != converter_format)
+		{
+			converter_format = (*decoded_frame)->format;
+			converter = PixelConvert::FindConverter(converter_format, PixelConvert::GetI420Format(converter_format));
+		}
+		double scale_start = Utility::GetTime();
+		if (upload_mode == UploadMode::LOCK || DisplayWindow::CanDrawDirectly((*decoded_frame)->format, (*decoded_frame)->width, (*decoded_frame)->height))
+		{
+			//With UploadMode::LOCK, Draw converts/resizes it straight into the texture instead.
+			//Renderer can take the decoder's planes as they are and scale them itself, so no conversion.
+			//Only a reference to the decoder's frame is queued, nothing is copied.
+			av_frame_unref(queued_frame->frame);
+			if (av_frame_ref(queued_frame->frame, *decoded_frame) < 0) continue;
+		}
+		else if (converter && DisplayWindow::CanDrawDirectly(AV_PIX_FMT_YUV420P, (*decoded_frame)->width, (*decoded_frame)->height))
+		{
+			//Only the chroma layout/bit depth differs, so convert at the video's own size with the SIMD kernels and let the renderer scale.
+			if (!converter(*decoded_frame, queued_frame->frame)) continue;
+		}
+		else
+		{
+			//Renderer can't take it as it is(format or size), so convert it to a size it does take. The renderer scales that to the window,
+			//so resizing the window doesn't change it.
+			SDL_Rect video_dimensions = DisplayWindow::GetVideoTextureDimensions((*decoded_frame)->width, (*decoded_frame)->height);
+			if (!video_file->ResizeVideoFrame(*decoded_frame, queued_frame->frame, video_dimensions.w, video_dimensions.h,
+				video_governor.GetScaleFlags())) continue;
+		}
+		//With UploadMode::LOCK, Draw times the conversion instead.
+		if (upload_mode != UploadMode::LOCK) video_governor.SetScaleTime(Utility::GetTime() - scale_start);
+		queued_frame->serial = serial;
+		queued_frame->pts = pts;
+		queued_frame->duration = duration;
+		video_frame_queue->Push();
+	}
+}
+
+/*
+	Runs on the audio device's thread, so it only copies converted audio out of audio_ring_buffer.
+	If there isn't enough, the rest is filled with silence and counted as an underrun.
 */
 void VideoPlayer::AudioCallback(void* userdata, Uint8* output_buffer, int buffer_length)
 {
-	//Don't play audio if it's ahead of actual video time.
-	double stream_timestamp = video_file->GetCurrentPTSTIME(CodecType::AUDIOCODEC);
-	if (isSeekedBackwards[1])
+	if (!audio_ring_buffer || audio_stream_index == -1)
 	{
-		isSeekedBackwards[1] = false;
-		stream_timestamp = 0;
+		std::memset(output_buffer, audio_device_specs.silence, buffer_length);
+		return;
 	}
-	if ((stream_timestamp > curr_video_time) || audio_stream_index == -1)
+	//Audio decode thread is waiting for the audio from before a seek to be thrown away.
+	if (isAudioFlushRequested)
 	{
-		for (int i = 0; i < buffer_length; i++)
+		audio_ring_buffer->Discard(audio_ring_buffer->Available());
+		isAudioFlushRequested = false;
+	}
+
+	//Time of the first sample in the ring.
+	double ring_timestamp = audio_ring_end_pts - audio_ring_buffer->Available() / audio_bytes_per_second;
+	//When audio isn't the master, it follows the master clock instead.
+	if (clock_master != ClockMaster::AUDIO)
+	{
+		//Time the audio given now will be heard.
+		double master_time = curr_video_time + audio_device_latency;
+		//Don't play audio if it's ahead of actual video time.
+		if (ring_timestamp > master_time + audio_sync_threshold)
 		{
-			output_buffer[i] = 0;
+			std::memset(output_buffer, audio_device_specs.silence, buffer_length);
+			return;
 		}
-		return;
+		//Too far behind, skip ahead to catch up.
+		if (ring_timestamp < master_time - audio_sync_threshold)
+		{
+			int behind_bytes = static_cast<int>((master_time - ring_timestamp) * audio_bytes_per_second);
+			behind_bytes -= behind_bytes % audio_bytes_per_sample_frame;
+			audio_ring_buffer->Discard(behind_bytes);
+			ring_timestamp = audio_ring_end_pts - audio_ring_buffer->Available() / audio_bytes_per_second;
+		}
+	}
+
+	int read_length = audio_ring_buffer->Read(output_buffer, buffer_length);
+	if (read_length < buffer_length)
+	{
+		std::memset(output_buffer + read_length, audio_device_specs.silence, buffer_length - read_length);
+		audio_underrun_count++;
 	}
-	/*if (next_audio_frame == nullptr || (*next_audio_frame)->data[0] == nullptr || (*next_audio_frame)->data[0][0] == '\0') return;*/
+	//Nothing played, so the time can't be measured from it.
+	if (read_length == 0) return;
+	//What's heard right now is what was given to the device about audio_device_latency ago, not what was just given.
+	double played_end_pts = ring_timestamp + read_length / audio_bytes_per_second;
+	audio_clock_publisher.Publish(played_end_pts - audio_device_latency, Utility::GetTime(), audio_ring_serial);
+}
 
-	//Stores excess audio data until next callback. 192000 is the max data size for audio codec in ffmpeg, so just make it 200000 jic.
-	static Uint8 audio_buffer[200000]{};
-	static int stored_data_size = 0;
-	static int stored_data_index = 0;
+/*
+	Runs on its own thread, decoding and converting audio into audio_ring_buffer ahead of when the callback needs it.
+	Converts straight into the ring with audio_resampler, and waits while the ring is full.
+*/
+void VideoPlayer::AudioDecodeLoop()
+{
+	int ring_serial = video_file->GetSerial();
+	audio_ring_serial = ring_serial;
+	//Frame waiting to be given to the resampler.
+	const AVFrame* input_frame = nullptr;
+	//Time at the end of the last frame given to the resampler.
+	double input_end_pts = 0;
+	//False while the resampler may still have converted audio that didn't fit in the ring.
+	bool isFrameNeeded = true;
 
-	while (buffer_length > 0)
+	while (isRun_AudioDecode)
 	{
-		if (stored_data_size > 0)
+		if (isFrameNeeded)
 		{
-			//Data stored is more than what's necessary, so just transfer until buffer is full and return.
-			if (stored_data_size > buffer_length)
+			AVFrame** decoded_frame = video_file->GetFrame(CodecType::AUDIOCODEC);
+			if (!decoded_frame)
 			{
-				//Start from [index, index + length - 1]
-				std::memcpy(output_buffer, audio_buffer + stored_data_index, buffer_length);
-				stored_data_size -= buffer_length;
-				//New index is index + length, or rather the endpt of the transfer.
-				stored_data_index += buffer_length;
-				return;
+				const VideoFileError* err = video_file->checkIsValid(CodecType::AUDIOCODEC);
+				if (err)
+				{
+					std::cout << err->message;
+					video_file->ResetErrorCodes(CodecType::AUDIOCODEC);
+				}
+				continue;
 			}
-			//If not, it means data needed is < what's currently available.
-			std::memcpy(output_buffer, audio_buffer + stored_data_index, stored_data_size); //Copy over everything.
-			buffer_length -= stored_data_size;
-			//No data left in buffer, so reset both size and index.
-			stored_data_size = 0;
-			stored_data_index = 0;
-			if (buffer_length == 0) return;
+
+			//First frame after a seek, so the audio still in the ring is from the old position.
+			//Only the callback can take out of the ring, so wait for it to throw that audio away.
+			int serial = video_file->GetCodecSerial(CodecType::AUDIOCODEC);
+			if (serial != ring_serial)
+			{
+				//Resampler's leftover samples are from the old position too.
+				if (audio_resampler) swr_init(audio_resampler);
+				isAudioFlushRequested = true;
+				while (isAudioFlushRequested && isRun_AudioDecode)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				ring_serial = serial;
+				audio_ring_serial = serial;
+			}
+
+			double frame_end_pts = video_file->GetCurrentPTSTIME(CodecType::AUDIOCODEC)
+				+ static_cast<double>((*decoded_frame)->nb_samples) / (*decoded_frame)->sample_rate;
+			//Before the time a seek was for, the seek landed on an earlier keyframe.
+			double seek_target = video_file->GetSeekTarget(CodecType::AUDIOCODEC);
+			if (seek_target >= 0 && frame_end_pts <= seek_target) continue;
+
+			//Only rebuilt if the stream's format changed mid-stream.
+			if (!ConfigureAudioResampler(*decoded_frame)) continue;
+			input_frame = *decoded_frame;
+			input_end_pts = frame_end_pts;
+			isFrameNeeded = false;
 		}
-		int retries = 8;
-		for (; retries > 0; retries--)
+
+		Uint8* region = nullptr;
+		int region_samples = audio_ring_buffer->GetWriteRegion(&region) / audio_bytes_per_sample_frame;
+		if (region_samples == 0)
 		{
-			if (GetAudio(audio_buffer, &stored_data_size)) break;
+			//Ring is full, wait for the callback to use some.
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			continue;
 		}
-		//If still unable to get audio then nvrm.
-		if (stored_data_size == 0)
+
+		//Input is buffered inside the resampler if it doesn't all fit, and is converted on the next call(with no new input).
+		int converted_samples = swr_convert(audio_resampler,
+			&region,
+			region_samples,
+			input_frame ? const_cast<const uint8_t**>(input_frame->extended_data) : nullptr,
+			input_frame ? input_frame->nb_samples : 0);
+		input_frame = nullptr;
+		if (converted_samples < 0)
 		{
-			break;
+			std::cout << "Unable to convert audio frame\n";
+			isFrameNeeded = true;
+			continue;
 		}
+		audio_ring_buffer->CommitWrite(converted_samples * audio_bytes_per_sample_frame);
+		//Anything still inside the resampler hasn't reached the ring yet.
+		audio_ring_end_pts = input_end_pts - static_cast<double>(swr_get_delay(audio_resampler, audio_device_specs.freq)) / audio_device_specs.freq;
+		//Space left over means everything the resampler could give is in the ring.
+		isFrameNeeded = converted_samples < region_samples;
 	}
 }
 
 /*
-	Stores audio inside audio_buffer provided.
+	(Re)builds audio_resampler if the frame's format, channel layout or sample rate doesn't match what it converts from.
+	Always converts to the format the audio device was opened with.
 	Returns false if unable to.
-	@param audio_buffer
-	- EMPTY buffer to store data into.
 */
-bool VideoPlayer::GetAudio(Uint8* audio_buffer, int* stored_size)
-{
-	if (audio_stream_index == -1) return false;
-	next_audio_frame = video_file->GetFrame(CodecType::AUDIOCODEC);
-	if (next_audio_frame == nullptr) return false;
-	AVCodecContext* codec_ctxt = video_file->GetStreamData(audio_stream_index).codecContext;
-	if (codec_ctxt == nullptr) return false;
-
-	//Convert audio into format used by audio device.
-	//Then put into audio buffer.
-	SwrContext* resampler = swr_alloc_set_opts(NULL,
-		codec_ctxt->channel_layout,
-		AV_SAMPLE_FMT_S16,
-		44100,
-		codec_ctxt->channel_layout,
-		codec_ctxt->sample_fmt,
-		codec_ctxt->sample_rate,
+bool VideoPlayer::ConfigureAudioResampler(const AVFrame* frame)
+{
+	int64_t in_layout = frame->channel_layout ? static_cast<int64_t>(frame->channel_layout) : av_get_default_channel_layout(frame->channels);
+	if (audio_resampler && frame->format == resampler_in_format && in_layout == resampler_in_layout && frame->sample_rate == resampler_in_rate)
+	{
+		return true;
+	}
+
+	swr_free(&audio_resampler);
+	audio_resampler = swr_alloc_set_opts(NULL,
+		av_get_default_channel_layout(audio_device_specs.channels),
+		audio_device_sample_format,
+		audio_device_specs.freq,
+		in_layout,
+		static_cast<AVSampleFormat>(frame->format),
+		frame->sample_rate,
 		0,
 		NULL);
-	swr_init(resampler);
-
-	int ret = 0;
-	AVFrame* audioframe = av_frame_alloc();
-	if (audioframe == nullptr) return false;
-	int dst_samples = static_cast<int>((*next_audio_frame)->channels * av_rescale_rnd(
-		swr_get_delay(resampler, (*next_audio_frame)->sample_rate)
-		+ (*next_audio_frame)->nb_samples,
-		44100,
-		(*next_audio_frame)->sample_rate,
-		AV_ROUND_UP));
-	uint8_t* audiobuf = NULL;
-	ret = av_samples_alloc(&audiobuf,
-		NULL,
-		1,
-		dst_samples,
-		AV_SAMPLE_FMT_S16,
-		1);
-	dst_samples = (*next_audio_frame)->channels * swr_convert(
-		resampler,
-		&audiobuf,
-		dst_samples,
-		(const uint8_t**)(*next_audio_frame)->data,
-		(*next_audio_frame)->nb_samples);
-	ret = av_samples_fill_arrays(audioframe->data,
-		audioframe->linesize,
-		audiobuf,
-		1,
-		dst_samples,
-		AV_SAMPLE_FMT_S16,
-		1);
-	if (ret < 0) return false;
-	swr_free(&resampler);
-
-	int stored_end_index{};
-	////Copy all data from frame to the buffer.
-	//for (int channel = 0; channel < audioframe->channels; channel++)
-	//{
-	//	//Don't check if the channel is null.
-	//	if (audioframe->data[channel] == nullptr) continue;
-	//	//Iterate over all data within the channel.
-	//	for (int i = 0; i < audioframe->linesize[0]; i++)
-	//	{
-	//		//TODO: maybe? 
-	//		//Null terminator indicates end of channel.
-	//		//if (audioframe->data[channel][i] == 0) break;
-	//		audio_buffer[stored_end_index] = audioframe->data[channel][i];
-	//		stored_end_index++;
-	//	}
-	//}
-	for (int i = 0; i < audioframe->linesize[0]; i++)
-	{
-		//TODO: maybe? 
-		//Null terminator indicates end of channel.
-		//if (audioframe->data[channel][i] == 0) break;
-		audio_buffer[stored_end_index] = audioframe->data[0][i];
-		stored_end_index++;
-	}
-	*stored_size = stored_end_index;
-	//TODO: free avframe "audioframe".
-	av_frame_unref(audioframe);
-	av_frame_free(&audioframe);
+	if (!audio_resampler || swr_init(audio_resampler) < 0)
+	{
+		std::cout << "Unable to create audio resampler\n";
+		swr_free(&audio_resampler);
+		return false;
+	}
+	resampler_in_format = frame->format;
+	resampler_in_layout = in_layout;
+	resampler_in_rate = frame->sample_rate;
 	return true;
 }
 
-
-
+void VideoPlayer::PrintAudioStats(std::ostream& output)
+{
+	if (!audio_ring_buffer) return;
+	output << "<<Audio Ring>>\n"
+		<< "Fill: " << audio_ring_buffer->Available() << "/" << audio_ring_buffer->Capacity() << " bytes"
+		<< ", underruns " << audio_underrun_count << "\n";
+}
 
 bool VideoPlayer::InitializeAudioDevice(const AVCodecContext* audio_codec_context)
 {
-	//TODO: account for when audio device format (have) does not match actual audio from codec_context, and convert audio to match.
 	if (!audio_codec_context)
 	{
 		std::cout << "Accessing non-existent codec context in DisplayWindow::PlayAVFrame()\n";
@@ -353,111 +741,321 @@ bool VideoPlayer::InitializeAudioDevice(const AVCodecContext* audio_codec_contex
 
 	//TODO: NOTE that VideoPlayer::AudioCallback is the one that is actually passing in the data, this just inits device.
 
-	//SwrContext* resampler = swr_alloc_set_opts(NULL,
-	//	audio_codec_context->channel_layout,
-	//	AV_SAMPLE_FMT_S16,
-	//	44100,
-	//	audio_codec_context->channel_layout,
-	//	audio_codec_context->sample_fmt,
-	//	audio_codec_context->sample_rate,
-	//	0,
-	//	NULL);
-	//swr_init(resampler);
-
-	//int ret = 0;
-	//AVFrame* frame = *audio_frame;
-	//AVFrame* audioframe = av_frame_alloc();
-	//int dst_samples = frame->channels * av_rescale_rnd(
-	//	swr_get_delay(resampler, frame->sample_rate)
-	//	+ frame->nb_samples,
-	//	44100,
-	//	frame->sample_rate,
-	//	AV_ROUND_UP);
-	//uint8_t* audiobuf = NULL;
-	//ret = av_samples_alloc(&audiobuf,
-	//	NULL,
-	//	1,
-	//	dst_samples,
-	//	AV_SAMPLE_FMT_S16,
-	//	1);
-	//dst_samples = frame->channels * swr_convert(
-	//	resampler,
-	//	&audiobuf,
-	//	dst_samples,
-	//	(const uint8_t**)frame->data,
-	//	frame->nb_samples);
-	//ret = av_samples_fill_arrays(audioframe->data,
-	//	audioframe->linesize,
-	//	audiobuf,
-	//	1,
-	//	dst_samples,
-	//	AV_SAMPLE_FMT_S16,
-	//	1);
-	/*SDL_QueueAudio(device,
-		(*audio_frame)->data[0],
-		(*audio_frame)->linesize[0]);*/
+	//Audio from the codec is converted to whatever format the device actually gave.
+	audio_device_sample_format = SDLToAVSampleFormat(audio_device_specs.format);
+	audio_bytes_per_sample_frame = audio_device_specs.channels * (SDL_AUDIO_BITSIZE(audio_device_specs.format) / 8);
+	audio_bytes_per_second = static_cast<double>(audio_device_specs.freq) * audio_bytes_per_sample_frame;
+	audio_device_latency = 2.0 * audio_device_specs.samples / audio_device_specs.freq;
+
+	//Resampler lives as long as the device, and is only rebuilt if the stream's format changes.
+	AVFrame codec_format{};
+	codec_format.format = audio_codec_context->sample_fmt;
+	codec_format.channel_layout = audio_codec_context->channel_layout;
+	codec_format.channels = audio_codec_context->channels;
+	codec_format.sample_rate = audio_codec_context->sample_rate;
+	if (!ConfigureAudioResampler(&codec_format))
+	{
+		SDL_CloseAudioDevice(audio_device);
+		audio_device = 0;
+		return false;
+	}
+
+	//Audio is decoded and converted ahead of time into a ring the callback copies from, so the callback never has to decode.
+	audio_ring_buffer = new AudioRingBuffer{ static_cast<int>(audio_bytes_per_second * audio_ring_seconds), audio_bytes_per_sample_frame };
+	isRun_AudioDecode = true;
+	audio_decode_thread = std::thread{ VideoPlayer::AudioDecodeLoop };
+
 	SDL_PauseAudioDevice(audio_device, 0);
 	return true;
+}
 
-	//TODO: free avframe "audioframe".
-	//swr_free(&resampler);
-	//SDL_CloseAudioDevice(device);
+//Returns the ffmpeg equivalent of an SDL audio format. Only packed formats, as SDL doesn't use planar ones.
+AVSampleFormat VideoPlayer::SDLToAVSampleFormat(SDL_AudioFormat format)
+{
+	switch (format)
+	{
+	case AUDIO_U8:
+		return AV_SAMPLE_FMT_U8;
+	case AUDIO_S32SYS:
+		return AV_SAMPLE_FMT_S32;
+	case AUDIO_F32SYS:
+		return AV_SAMPLE_FMT_FLT;
+	default:
+		return AV_SAMPLE_FMT_S16;
+	}
 }
 
 void VideoPlayer::SeekVideo(double offset)
 {
-	int flag = (offset < 0) ? AVSEEK_FLAG_BACKWARD : 0;
-	//flag = flag | AVSEEK_FLAG_ANY;
-	double seek_target = curr_video_time;
-	seek_target += offset;
+	SeekTo(curr_video_time + offset);
+}
+
+void VideoPlayer::SeekTo(double seek_target)
+{
 	if (seek_target < 0) return;
+	//Don't seek too far.
+	if (seek_target > video_file->GetVideoDuration()) return;
+	//Carries on backwards from there, forward decoding is seeked once reverse playback stops.
+	if (reverse_decoder)
+	{
+		StartReverse(seek_target);
+		return;
+	}
 
-	int ret_audio = -1, ret_video = -1;
+	//The demux thread does the actual seek, flushing the packet queues. Codecs are flushed once they reach the packets from the new position.
+	//Lands on the keyframe before the target, frames up to the target are decoded and thrown away.
+	//Serial comes from the request, read before the demux thread can seek(e.g. replaying from its back buffer), so no frame after the seek is dropped.
+	seek_serial = video_file->Seek(seek_target);
+	//Measured when the first frame from the new position is presented. A seek still pending is replaced, so isn't measured.
+	seek_request_time = Utility::GetTime();
+	seek_target_time = seek_target;
+	isSeekMeasurePending = true;
+	//Keeps the last frame up and holds time and audio, until the new position's first frame is ready.
+	//Without this the clock runs on during the seek, and the first frames after it are dropped as late.
+	if (video_frame_queue)
+	{
+		isSeekHolding = true;
+		ApplyPaused();
+	}
+	//Decoder is restarted from the target, so it matches what's shown again.
+	isStepped = false;
+	//Already decoded(e.g. a short seek back), so it's shown straight away while the decoder gets there.
+	double cached_pts = 0, cached_duration = 0;
+	if (video_frame_cache && video_frame_cache->Find(seek_target, step_frame, cached_pts, cached_duration) && DrawLockedFrame(step_frame))
+	{
+		displayed_pts = cached_pts;
+		displayed_duration = cached_duration;
+	}
 
-	int64_t seek_target_timebase = static_cast<int64_t>(seek_target * AV_TIME_BASE);
-	
+	//Update new video time, basically start anew at the new timestamp.
+	//Audio from the old position is thrown away once the new position is decoded, and ignored by the audio clock until then.
+	audio_clock.Set(seek_target);
+	video_clock.Set(seek_target);
+	external_clock.Set(seek_target);
+	curr_video_time = seek_target;
+}
 
-	if (audio_stream_index != -1)
+void SeekStats::Record(double error, double latency)
+{
+	count++;
+	totalError += error;
+	totalLatency += latency;
+	if (error > maxError) maxError = error;
+	if (latency > maxLatency) maxLatency = latency;
+}
+
+void SeekStats::Print(std::ostream& output) const
+{
+	if (count == 0) return;
+	output << "<<Seeks>>\n"
+		<< "Seeks: " << count << "\n"
+		<< "Accuracy: average " << totalError / count * 1000 << " ms, worst " << maxError * 1000 << " ms off target\n"
+		<< "Seek to first frame: average " << totalLatency / count * 1000 << " ms, worst " << maxLatency * 1000 << " ms\n";
+}
+
+void VideoPlayer::SetPaused(bool isPaused)
+{
+	//Reverse position stays where it's paused.
+	if (reverse_decoder)
 	{
-		//Conversion from double(in seconds) to stream->time_base.
-		//As double * stream->time_base is not defined, av_rescale_q is used as a roundabout way of conversion.
-		//seek_target * AV_TIME_BASE --> / AV_TIME_BASE --> * stream->time_base.
-		int64_t audio_seek_target = av_rescale_q(seek_target_timebase, av_make_q(1, AV_TIME_BASE), video_file->GetStreamData(audio_stream_index).stream->time_base);
-		//Don't seek too far.
-		if (audio_seek_target > video_file->GetStreamData(audio_stream_index).stream->duration) return;
-		ret_audio = av_seek_frame(video_file->GetFormatContext(), audio_stream_index, audio_seek_target, flag);
+		reverse_pts = GetReversePosition();
+		reverse_time = Utility::GetTime();
 	}
+	isUserPaused = isPaused;
+	ApplyPaused();
+	//Audio(and the decoder, if stepped from the cache) is still where the steps started, so carry on from the frame on screen instead.
+	if (!isPaused && isStepped) SeekTo(displayed_pts);
+}
 
-	//TODO: Issue with seeking to time = 59. e.g. 45s --> 55s, but it instead goes to 59s.
-	if (video_stream_index != -1)
+void VideoPlayer::StepFrame(int direction)
+{
+	if (!video_frame_queue || direction == 0) return;
+	//Steps from where reverse playback got to, once forward decoding has caught up.
+	if (reverse_decoder) SetReverse(0);
+	//Otherwise the next frame would replace it straight away.
+	if (!isUserPaused) SetPaused(true);
+	//A seek is still on its way, its frame becomes the one stepped from.
+	if (isSeekHolding) return;
+
+	double pts = 0, duration = 0;
+	if (direction > 0)
 	{
-		int64_t video_seek_target = av_rescale_q(seek_target_timebase, av_make_q(1, AV_TIME_BASE), video_file->GetStreamData(video_stream_index).stream->time_base);
-		//double video_seek_time = (double)video_seek_target * ((double)video_file->GetStreamData(video_stream_index).stream->time_base.num / video_file->GetStreamData(video_stream_index).stream->time_base.den);
-		//if (video_seek_time > seek_target + 0.01)
-		//{
-		//	for (int i = 0; i < 100; i++)
-		//	{
-		//		std::cout << "MisMatch time\n";
-		//	}
-		//}
-		//Don't seek too far.
-		if (video_seek_target > video_file->GetStreamData(video_stream_index).stream->duration) return;
-		ret_video = av_seek_frame(video_file->GetFormatContext(), video_stream_index, video_seek_target, flag);
-	}
-
-	//If either seek is successful
-	if (ret_audio >= 0 || ret_video >= 0)
-	{
-		//Update new video time.
-		curr_video_time += offset;
-		//Flush buffers and clear leftover packets, basically start anew at the new timestamp.
-		video_file->ClearAllPackets();
-		video_file->FlushAllBuffers();
-		if (offset < 0)
+		//Frames from before a seek, or already stepped past.
+		QueuedFrame* queued_frame = nullptr;
+		while ((queued_frame = video_frame_queue->Peek()) != nullptr
+			&& (queued_frame->serial != video_file->GetSerial() || queued_frame->pts < displayed_pts + displayed_duration / 2))
+		{
+			video_frame_queue->Pop();
+		}
+		//Usually already decoded and waiting in the queue.
+		if (queued_frame && std::abs(queued_frame->pts - (displayed_pts + displayed_duration)) < displayed_duration / 2)
 		{
-			isSeekedBackwards[0] = isSeekedBackwards[1] = true;
+			if (upload_mode == UploadMode::LOCK) DrawLockedFrame(queued_frame->frame);
+			else DisplayWindow::DrawAVFrame(&queued_frame->frame);
+			pts = queued_frame->pts;
+			duration = queued_frame->duration;
+			//Decoded before pausing, so it isn't cached yet. Kept so stepping back to it doesn't decode it again.
+			if (video_frame_cache) video_frame_cache->Insert(queued_frame->frame, pts, duration);
+			video_frame_queue->Pop();
+			SetSteppedFrame(pts, duration);
+			return;
 		}
+		if (video_frame_cache && video_frame_cache->FindNext(displayed_pts, displayed_duration, step_frame, pts, duration)
+			&& DrawLockedFrame(step_frame))
+		{
+			SetSteppedFrame(pts, duration);
+			return;
+		}
+		//Middle of the next frame, so timestamp rounding can't land on either side of it.
+		SeekTo(displayed_pts + displayed_duration * 1.5);
+		return;
+	}
+	if (video_frame_cache && video_frame_cache->FindPrevious(displayed_pts, step_frame, pts, duration) && DrawLockedFrame(step_frame))
+	{
+		SetSteppedFrame(pts, duration);
+		return;
+	}
+	//Not cached, decodes from the keyframe before it. Middle of the previous frame.
+	SeekTo(displayed_pts - displayed_duration / 2);
+}
+
+void VideoPlayer::SetSteppedFrame(double pts, double duration)
+{
+	displayed_pts = pts;
+	displayed_duration = duration;
+	//Clocks are paused, so they stay on it.
+	audio_clock.Set(pts);
+	video_clock.Set(pts);
+	external_clock.Set(pts);
+	curr_video_time = pts;
+	isStepped = true;
+}
+
+void VideoPlayer::ApplyPaused()
+{
+	bool isPaused = isUserPaused || isSeekHolding || reverse_decoder != nullptr;
+	isFrameCacheFilling = isUserPaused;
+	if (audio_device != 0) SDL_PauseAudioDevice(audio_device, isPaused ? 1 : 0);
+	audio_clock.SetPaused(isPaused);
+	video_clock.SetPaused(isPaused);
+	external_clock.SetPaused(isPaused);
+}
+
+void VideoPlayer::ReleaseSeekHold(double pts)
+{
+	isSeekHolding = false;
+	audio_clock.Set(pts);
+	video_clock.Set(pts);
+	external_clock.Set(pts);
+	curr_video_time = pts;
+	ApplyPaused();
+}
+
+void VideoPlayer::SetClockMaster(ClockMaster master)
+{
+	if (master == ClockMaster::AUDIO && (audio_stream_index == -1 || audio_device == 0)) master = ClockMaster::EXTERNAL;
+	if (master == ClockMaster::VIDEO && video_stream_index == -1) master = ClockMaster::EXTERNAL;
+	if (master != clock_master)
+	{
+		//Carry on from the current time, so switching doesn't jump.
+		double now = GetMasterTime();
+		audio_clock.Set(now);
+		video_clock.Set(now);
+		external_clock.Set(now);
 	}
+	clock_master = master;
+}
+
+ClockMaster VideoPlayer::GetClockMaster()
+{
+	return clock_master;
+}
 
-	
+double VideoPlayer::GetMasterTime()
+{
+	switch (clock_master)
+	{
+	case ClockMaster::AUDIO:
+		return audio_clock.Get();
+	case ClockMaster::VIDEO:
+		return video_clock.Get();
+	default:
+		return external_clock.Get();
+	}
+}
+
+void VideoPlayer::SetReverse(double speed)
+{
+	if (!video_frame_queue) return;
+	if (speed <= 0)
+	{
+		if (!reverse_decoder) return;
+		reverse_decoder->PrintStats(std::cout);
+		delete reverse_decoder;
+		reverse_decoder = nullptr;
+		reverse_speed = 0;
+		//Forward decoding stopped where reversing started, so carry on forwards from the frame on screen.
+		SeekTo(displayed_pts);
+		return;
+	}
+	if (reverse_decoder)
+	{
+		//Carries on from where it got to.
+		reverse_pts = GetReversePosition();
+		reverse_time = Utility::GetTime();
+		reverse_speed = speed;
+		return;
+	}
+	reverse_speed = speed;
+	StartReverse(displayed_pts);
+}
+
+void VideoPlayer::StartReverse(double seconds)
+{
+	delete reverse_decoder;
+	AVStream* video_stream = video_file->GetStreamData(video_stream_index).stream;
+	reverse_decoder = new ReverseDecoder{ video_filepath, video_stream, video_file->GetKeyframeIndex(), seconds, reverse_config };
+	reverse_pts = seconds;
+	reverse_time = Utility::GetTime();
+	isReverseStalled = false;
+	//Seeks being held or measured were for forward playback.
+	isSeekHolding = false;
+	isSeekMeasurePending = false;
+	ApplyPaused();
+}
+
+double VideoPlayer::GetReversePosition()
+{
+	if (isUserPaused) return reverse_pts;
+	return reverse_pts - (Utility::GetTime() - reverse_time) * reverse_speed;
+}
+
+void VideoPlayer::DrawReverse()
+{
+	if (reverse_decoder->IsFailed())
+	{
+		std::cout << "Unable to open the video to play it in reverse\n";
+		SetReverse(0);
+		return;
+	}
+	double now = Utility::GetTime();
+	double position = GetReversePosition();
+	double pts = 0, duration = 0;
+	if (!reverse_decoder->GetFrame(position, step_frame, pts, duration))
+	{
+		//Frames before aren't decoded yet, so hold where it is rather than skip them.
+		reverse_time = now;
+		isReverseStalled = true;
+		return;
+	}
+	isReverseStalled = false;
+	reverse_pts = position;
+	reverse_time = now;
+	//Still showing.
+	if (pts == displayed_pts) return;
+	DrawLockedFrame(step_frame);
+	//Moves on even if it couldn't be drawn, so it isn't tried again every loop.
+	displayed_pts = pts;
+	displayed_duration = duration;
+	curr_video_time = pts;
 }
@@ -12,7 +12,31 @@
 */
 
 #include <string>
+#include <thread>
+#include <atomic>
 #include "ffmpeg_videoFileFunctions.hpp"
+#include "FrameQueue.hpp"
+#include "FrameCache.hpp"
+#include "ReverseDecoder.hpp"
+#include "AudioRingBuffer.hpp"
+#include "Clock.hpp"
+#include "FrameScheduler.hpp"
+#include "QualityGovernor.hpp"
+#include "PixelConvert.hpp"
+#include "SliceScaler.hpp"
+#include "Display.hpp"
+
+//How close seeks land to their target, and how long until the first frame from there is shown.
+struct SeekStats
+{
+	int count = 0;
+	double totalError = 0, maxError = 0; //Seconds between the target and the first frame presented.
+	double totalLatency = 0, maxLatency = 0; //Seconds from the seek until that frame is presented.
+
+	void Record(double error, double latency);
+	void Print(std::ostream& output) const;
+};
+
 /*
 	There'll only be one instance of this class, representing the current video being played.
 	Does not only control reading of data from file, but also displaying of data to window. 
@@ -22,12 +46,123 @@ class VideoPlayer
 	static std::string video_filepath;
 	//The file to read data from.
 	static VideoFile* video_file;
-	//Representing the current video timestamp. Used for sync.
-	static double curr_video_time;
+	//Passed to each VideoFile opened.
+	static DecoderConfig decoder_config;
+	static OpenConfig open_config;
+	//When Initialize started opening the file, and seconds from then until the first frame was presented(-1 until it is).
+	static double open_start_time;
+	static double time_to_first_frame;
+	//Representing the current video timestamp, taken from the master clock every Update. Used for sync.
+	static std::atomic<double> curr_video_time;
+
+	//Clock everything else is synced to.
+	static std::atomic<ClockMaster> clock_master;
+	//Time of the audio coming out of the device, kept from what AudioCallback publishes.
+	static Clock audio_clock;
+	//Time of the video frame being displayed.
+	static Clock video_clock;
+	//Free running time, only moved when seeking.
+	static Clock external_clock;
+	//Lets AudioCallback pass the time of the audio it just played to the main thread.
+	static ClockPublisher audio_clock_publisher;
+	//Seconds of audio between a callback and it being heard. SDL keeps about two buffers queued.
+	static double audio_device_latency;
+	//Seconds audio may be off the master clock before AudioCallback drops or holds back audio.
+	static constexpr double audio_sync_threshold = 0.05;
 
 	static int audio_stream_index, video_stream_index;
-	//Storage for the frames read from the file.
-	static AVFrame **next_video_frame, **next_audio_frame;
+	//Decoded and resized video frames, kept ahead of time by the video decode thread. Only Draw takes frames out.
+	static FrameQueue* video_frame_queue;
+	//Number of frames the video decode thread keeps ready.
+	static const int video_frame_queue_size = 6;
+	//Seconds per frame from the stream's frame rate, for frames with no duration.
+	static double video_frame_interval;
+	//Frames decoded while paused, kept so stepping and short backward seeks don't decode them again. Null if disabled.
+	static FrameCache* video_frame_cache;
+	//Set while the user has paused, the only time the decode thread fills video_frame_cache. Playing never copies frames into it.
+	static std::atomic<bool> isFrameCacheFilling;
+	//Bytes video_frame_cache may keep, applies to the next video initialized. 0 disables it.
+	static int64_t frame_cache_budget;
+	//Reference to the cached frame last drawn. Main thread only.
+	static AVFrame* step_frame;
+	//Time and duration of the frame on screen.
+	static double displayed_pts, displayed_duration;
+	//Set once a frame is stepped to, so unpausing seeks to it, bringing audio and the decoder back in line.
+	static bool isStepped;
+
+	//Decodes backwards while playing in reverse, null otherwise. Forward decoding and audio are paused meanwhile.
+	static ReverseDecoder* reverse_decoder;
+	//Passed to each ReverseDecoder started.
+	static ReverseConfig reverse_config;
+	//Times normal speed, 0 if not playing in reverse.
+	static double reverse_speed;
+	//Position reverse playback was at, at reverse_time. Only moves on while frames are ready.
+	static double reverse_pts, reverse_time;
+	static bool isReverseStalled;
+	//Starts decoding backwards from seconds, replacing any reverse decoder already running.
+	static void StartReverse(double seconds);
+	//Position reverse playback is at now.
+	static double GetReversePosition();
+	//Draw while playing in reverse.
+	static void DrawReverse();
+	static std::thread video_decode_thread;
+	static std::atomic<bool> isRun_VideoDecode;
+	//Serial the video decoder last gave its last frame under, so a seek past the end stops holding.
+	static std::atomic<int> video_ended_serial;
+	//Decides when queued frames are presented, and drops the ones that are too late.
+	static FrameScheduler video_scheduler;
+	//Steps decode/scale quality down when they can't keep up with the frame rate, and back up when they can.
+	static QualityGovernor video_governor;
+	//Process CPU time when the video started, to work out CPU time per presented frame.
+	static double cpu_seconds_at_start;
+	//DisplayWindow's upload mode when the video started. Fixed for the whole video, as the decode thread relies on it.
+	static UploadMode upload_mode;
+	//UploadMode::LOCK, and frames from video_frame_cache in either mode. Frames are queued as they come out of the decoder, and converted/scaled by Draw straight into the texture.
+	//Only used on the main thread, as that's the only one allowed to lock textures.
+	static int lock_converter_format;
+	static PixelConvert::Converter lock_converter;
+	static SliceScaler* lock_scaler;
+
+	//Draws a decoder frame into a locked texture, converting or resizing it on the way. Returns false if unable to.
+	static bool DrawLockedFrame(AVFrame* frame);
+	//Makes the frame just drawn by a step the current position.
+	static void SetSteppedFrame(double pts, double duration);
+	//Seeks exactly to seek_target seconds.
+	static void SeekTo(double seek_target);
+
+	//Video decode thread's loop. Decodes and resizes frames into video_frame_queue until isRun_VideoDecode is false.
+	static void VideoDecodeLoop();
+	//Logs the governor's new stage, and applies its decoder settings. Video decode thread only.
+	static void ApplyQualityStage(QualityGovernor::Stage previous_stage);
+
+	//Audio converted to the device's format, kept ahead of time by the audio decode thread. Only AudioCallback takes audio out.
+	static AudioRingBuffer* audio_ring_buffer;
+	//Seconds of audio audio_ring_buffer can hold.
+	static constexpr double audio_ring_seconds = 0.5;
+	static std::thread audio_decode_thread;
+	static std::atomic<bool> isRun_AudioDecode;
+	//Set by the audio decode thread after a seek, so AudioCallback throws away the audio in the ring. Cleared once done.
+	static std::atomic<bool> isAudioFlushRequested;
+	//Presentation time at the end of the audio in audio_ring_buffer.
+	static std::atomic<double> audio_ring_end_pts;
+	//Seek serial of the audio in audio_ring_buffer.
+	static std::atomic<int> audio_ring_serial;
+	static double audio_bytes_per_second;
+	//Number of callbacks that had to be padded with silence as the ring ran out.
+	static std::atomic<int> audio_underrun_count;
+
+	//Converts decoded audio to the device's format. Created once with the device, only rebuilt if the stream's format changes.
+	static SwrContext* audio_resampler;
+	//Format audio_resampler converts from.
+	static int resampler_in_format;
+	static int64_t resampler_in_layout;
+	static int resampler_in_rate;
+	//Format the audio device was actually opened with.
+	static AVSampleFormat audio_device_sample_format;
+	static int audio_bytes_per_sample_frame;
+
+	//Audio decode thread's loop. Decodes and converts audio into audio_ring_buffer until isRun_AudioDecode is false.
+	static void AudioDecodeLoop();
 
 	static SDL_AudioSpec audio_device_specs;
 
@@ -39,11 +174,74 @@ public:
 	static bool Initialize(std::string video_filepath);
 	static void Update();
 	static void Draw();
+	//Presents the last drawn frame again, e.g. after the window was covered.
+	static void Redraw();
+	//Threading policy decoders are opened with, applies to the next video initialized.
+	static void SetDecoderConfig(const DecoderConfig& config) { decoder_config = config; }
+	static DecoderConfig GetDecoderConfig() { return decoder_config; }
+	//How much probing opening a file does, applies to the next video initialized.
+	static void SetOpenConfig(const OpenConfig& config) { open_config = config; }
+	static OpenConfig GetOpenConfig() { return open_config; }
+	//Call when the window changes size. Fits the video to it, and lets decoding follow the new size.
+	static void HandleWindowResize();
+	/*
+		Milliseconds the main loop can sleep before the next frame is due to be drawn.
+		Capped at max_idle_wait_ms, and short if no frame is ready yet.
+	*/
+	static int GetMillisecondsToNextFrame();
+	static const int max_idle_wait_ms = 100;
+	//How often to check back while waiting for the video decode thread.
+	static const int decode_wait_ms = 5;
 	static void Free();
 	static void AudioCallback(void* userdata, Uint8* buffer, int buffer_length);
 	static bool InitializeAudioDevice(const AVCodecContext* audio_codec_context);
-	static bool GetAudio(Uint8* audio_buffer, int* stored_size);
+	static bool ConfigureAudioResampler(const AVFrame* frame);
+	static AVSampleFormat SDLToAVSampleFormat(SDL_AudioFormat format);
+	//Prints fill level and underrun count of the audio ring.
+	static void PrintAudioStats(std::ostream& output);
 
+	//Seeks offset seconds from the current time, exactly to that time.
 	static void SeekVideo(double offset);
+	/*
+		Pauses and shows the next(direction > 0) or previous(direction < 0) frame.
+		Served from the queue or video_frame_cache if they have it, else seeks exactly to it.
+	*/
+	static void StepFrame(int direction);
+	/*
+		Plays backwards from the frame on screen at speed times normal speed, without audio.
+		Changing the speed carries on from where it got to. 0 goes back to playing forwards from there.
+	*/
+	static void SetReverse(double speed);
+	static double GetReverseSpeed() { return reverse_speed; }
+	//How many chunks are decoded ahead and how big, applies to the next reverse started.
+	static void SetReverseConfig(const ReverseConfig& config) { reverse_config = config; }
+	static ReverseConfig GetReverseConfig() { return reverse_config; }
+	//Memory the decoded frame cache may use, applies to the next video initialized. 0 disables it.
+	static void SetFrameCacheBudget(int64_t bytes) { frame_cache_budget = bytes; }
+	static int64_t GetFrameCacheBudget() { return frame_cache_budget; }
+	//Seek being measured, until its first frame is presented.
+	static double seek_request_time;
+	static double seek_target_time;
+	//Serial frames from after the seek have. Lower serials are from before it.
+	static int seek_serial;
+	static bool isSeekMeasurePending;
+	//Set from a seek until its first frame is presented. Clocks and audio are held meanwhile, while the last frame stays on screen.
+	static bool isSeekHolding;
+	//Seconds to hold for at most, e.g. if the seek landed past the end.
+	static constexpr double seek_hold_timeout = 1.0;
+	//Set by SetPaused, so holding for a seek doesn't unpause.
+	static bool isUserPaused;
+	//Pauses the audio device and clocks if the user paused or a seek is holding, else runs them.
+	static void ApplyPaused();
+	//Ends the hold, continuing from pts.
+	static void ReleaseSeekHold(double pts);
+	static SeekStats seek_stats;
+	//Pauses/unpauses the audio device and all clocks.
+	static void SetPaused(bool isPaused);
+	//Chooses the clock the others sync to. Falls back to EXTERNAL if the chosen stream isn't available.
+	static void SetClockMaster(ClockMaster master);
+	static ClockMaster GetClockMaster();
+	//Current time of the master clock.
+	static double GetMasterTime();
 };
 
@@ -54,4 +54,26 @@ std::string BasicFileOpen()
         CoUninitialize();
     }
     return file_choice;
+}
+
+double GetProcessCPUSeconds()
+{
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) return 0;
+    // FILETIME is in 100 nanosecond units.
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return static_cast<double>(kernel.QuadPart + user.QuadPart) / 10000000.0;
+}
+
+void SetCurrentThreadBackground()
+{
+    // Background mode lowers disk and memory priority as well, not just CPU.
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN))
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+    }
 }
\ No newline at end of file
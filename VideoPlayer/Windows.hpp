@@ -2,4 +2,8 @@
 #define WINDOWS_HPP
 #include <string>
 std::string BasicFileOpen();
+//Seconds of CPU time(user + kernel) used by the whole process so far.
+double GetProcessCPUSeconds();
+//Lowers the calling thread's CPU and I/O priority, for background work that shouldn't slow down playback.
+void SetCurrentThreadBackground();
 #endif
\ No newline at end of file
@@ -5,123 +5,278 @@
 */
 
 #include "ffmpeg_videoFileFunctions.hpp"
+#include "ProbeCache.hpp"
+#include "Utility.hpp"
 #include <iostream>
 #include <fstream>
 #include <string>
-bool isFlush[5]{ false, false, false, false, false };
+#include <thread>
+#include <chrono>
 
-PacketData::PacketData()
+AVPacket* VideoFile::GetPacket(CodecType codecType)
 {
-	packet = av_packet_alloc();
-	//TODO: remove
-	//this->packet = nullptr;
+	int index = GetStreamIndex(codecType);
+	AVPacket* packet = codecPackets[static_cast<int>(codecType)];
+	if (index < 0 || !packet || !demuxer) return nullptr;
+
+	int serial = 0;
+	//Short wait, so the decode threads get back to checking their run flag and the seek serial promptly.
+	if (!demuxer->PopPacket(index, packet, &serial, 5)) return nullptr;
+	CheckSerial(codecType, serial);
+	return packet;
 }
 
-PacketData::~PacketData()
+void VideoFile::CheckSerial(CodecType codecType, int serial)
 {
-	if (packet)
+	int& codecSerial = codecSerials[static_cast<int>(codecType)];
+	if (codecSerial == serial) return;
+	codecSerial = serial;
+	//Flushing also takes the codec out of draining, so it takes packets again.
+	isCodecEnded[static_cast<int>(codecType)] = false;
+	if (codecType == CodecType::VIDEOCODEC) ClearDrainedFrames();
+	avcodec_flush_buffers(streamArr[GetStreamIndex(codecType)].codecContext);
+}
+
+int VideoFile::Seek(double seconds)
+{
+	if (!demuxer) return -1;
+	KeyframeEntry keyframe{};
+	if (keyframeIndex && keyframeIndex->Find(seconds, keyframe))
 	{
-		AVPacket* packetData = packet;
-		//Dereference buffer.
-		av_packet_unref(packetData);
-		av_packet_free(&packetData);
-		packet = nullptr;
+		const AVStream* stream = videoContainer->streams[videoStreamIndex];
+		//Formats without an index of their own(e.g. MPEG-TS) seek by guessing, so go straight to the keyframe's byte position.
+		bool isByteSeek = stream->nb_index_entries == 0 && keyframe.position >= 0 && !(videoContainer->iformat->flags & AVFMT_NO_BYTE_SEEK);
+		if (isByteSeek) return demuxer->RequestSeek(keyframe.position, AVSEEK_FLAG_BYTE, -1, seconds);
+		//Exactly the keyframe's pts, so the demuxer has no keyframe to pick but that one.
+		return demuxer->RequestSeek(keyframe.pts, AVSEEK_FLAG_BACKWARD, videoStreamIndex, seconds);
 	}
+	//Index isn't ready, so let the demuxer find the keyframe. Always the one before, forward seeks used to land on the one after.
+	return demuxer->RequestSeek(static_cast<int64_t>(seconds * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD, -1, seconds);
+}
+
+double VideoFile::GetSeekTarget(CodecType codecType)
+{
+	if (!demuxer) return -1;
+	return demuxer->GetSeekTarget(codecSerials[static_cast<int>(codecType)]);
+}
+
+void VideoFile::PrintKeyframeIndexStats(std::ostream& output)
+{
+	if (keyframeIndex) keyframeIndex->PrintStats(output);
 }
 
+void VideoFile::PrintPacketQueueStats(std::ostream& output)
+{
+	if (demuxer) demuxer->PrintStats(output);
+}
+
+void VideoFile::SetDemuxConfig(const DemuxConfig& demuxConfig)
+{
+	if (demuxer) demuxer->SetConfig(demuxConfig);
+}
+
+void VideoFile::SetSkipFrame(CodecType codecType, AVDiscard discard)
+{
+	int streamIndex = GetStreamIndex(codecType);
+	if (streamIndex < 0 || !streamArr[streamIndex].codecContext) return;
+	streamArr[streamIndex].codecContext->skip_frame = discard;
+}
 
-AVPacket** VideoFile::GetPacket(CodecType codecType, bool isClearPackets)
+void VideoFile::SetTargetDimensions(int width, int height)
 {
-	//TODO: using a list may be more efficient when removing front element.
-	//Update packet queue and remove packets which were read by all codecs.
+	targetWidth = width;
+	targetHeight = height;
+}
 
-	std::list<PacketData>::iterator iter;
+void VideoFile::SetMinDecodeReduction(int minReduction, bool isSkipLoopFilter)
+{
+	minDecodeReduction = minReduction;
+	isSkipLoopFilterRequested = isSkipLoopFilter;
+}
 
-	//Only set to true, when avcodec_receive_frame has been done. 
-	//This'll prevent packets from being cleared prematurely(even if all codecs have read it) if it's still being used by avcodec_receive_frame.
-	if (isClearPackets)
+void VideoFile::ApplyDecodeReduction()
+{
+	if (videoStreamIndex < 0) return;
+	StreamData& streamData = streamArr[videoStreamIndex];
+	if (!streamData.codecContext) return;
+
+	//Halves the decode size for as long as it still covers the target.
+	int width = targetWidth, height = targetHeight;
+	int reduction = 0;
+	if (width > 0 && height > 0)
 	{
-		//Emergency clear if packet list gets too big, 1000 is an arbitrary large number.
-		if (packetArr.size() >= 500)
+		while (reduction < maxDecodeReduction
+			&& (streamData.codecParam->width >> (reduction + 1)) >= width
+			&& (streamData.codecParam->height >> (reduction + 1)) >= height)
 		{
-			int counter = 0;
-			//Clear the first 500 of the list.
-			for (iter = packetArr.begin(); iter != packetArr.end() && counter < 250; counter++)
-			{
-				//Erase the current element and move to the next.
-				iter = packetArr.erase(iter);
-			}
+			reduction++;
 		}
-		bool breakLoop = false;
-		for (iter = packetArr.begin(); iter != packetArr.end();) //Note the lack of iter++, as the loop won't increment until a packet is removed.
+	}
+	if (reduction < minDecodeReduction) reduction = minDecodeReduction;
+	//Codecs without lowres(e.g. h264, hevc) decode at full size either way, so cut the cost of each frame instead.
+	int maxLowres = streamData.codec ? streamData.codec->max_lowres : 0;
+	int lowres = reduction < maxLowres ? reduction : maxLowres;
+	bool isFastDecode = reduction > 0 && maxLowres == 0;
+
+	if (lowres != videoLowres)
+	{
+		if (!ReopenCodec(streamData, lowres)) return;
+		videoLowres = lowres;
+		std::cout << "Video decoding at 1/" << (1 << lowres) << " resolution\n";
+	}
+	if (isFastDecode != isVideoFastDecode)
+	{
+		if (isFastDecode) streamData.codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+		else streamData.codecContext->flags2 &= ~AV_CODEC_FLAG2_FAST;
+		isVideoFastDecode = isFastDecode;
+		std::cout << "Video fast decoding " << (isFastDecode ? "on" : "off") << "\n";
+	}
+	bool isSkipLoopFilter = isFastDecode || isSkipLoopFilterRequested;
+	if (isSkipLoopFilter != isVideoLoopFilterSkipped)
+	{
+		streamData.codecContext->skip_loop_filter = isSkipLoopFilter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+		isVideoLoopFilterSkipped = isSkipLoopFilter;
+	}
+}
+
+void VideoFile::ConfigureThreading(AVCodecContext* codecContext, const StreamData& streamData) const
+{
+	if (!codecContext || !streamData.codec) return;
+	const DecoderThreadConfig& config = streamData.codecParam->codec_type == AVMEDIA_TYPE_VIDEO ? decoderConfig.video : decoderConfig.audio;
+	bool isLowDelay = config.isLowDelay || (config.isLowDelayWhenLive && IsLiveSource());
+	bool hasFrameThreads = (streamData.codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+	bool hasSliceThreads = (streamData.codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+
+	//Falls back to whatever the codec has, frame threading is never used for low delay.
+	DecoderThreading threading = config.threading;
+	if (threading == DecoderThreading::AUTO) threading = (hasFrameThreads && !isLowDelay) ? DecoderThreading::FRAME : DecoderThreading::SLICE;
+	if (threading == DecoderThreading::FRAME && (!hasFrameThreads || isLowDelay)) threading = DecoderThreading::SLICE;
+	if (threading == DecoderThreading::SLICE && !hasSliceThreads) threading = DecoderThreading::NONE;
+
+	int threadCount = config.threadCount;
+	if (threadCount <= 0)
+	{
+		//Roughly one thread per 480p worth of pixels, at least 2 if it's threaded at all.
+		int64_t pixels = static_cast<int64_t>(streamData.codecParam->width) * streamData.codecParam->height;
+		threadCount = static_cast<int>(pixels / (640 * 480)) + 1;
+		if (threadCount < 2) threadCount = 2;
+		int cores = static_cast<int>(std::thread::hardware_concurrency());
+		if (cores > 0 && threadCount > cores) threadCount = cores;
+		if (threadCount > maxAutoThreads) threadCount = maxAutoThreads;
+	}
+	if (threading == DecoderThreading::NONE) threadCount = 1;
+
+	codecContext->thread_count = threadCount;
+	codecContext->thread_type = threading == DecoderThreading::FRAME ? FF_THREAD_FRAME
+		: threading == DecoderThreading::SLICE ? FF_THREAD_SLICE : 0;
+	if (isLowDelay) codecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+}
+
+bool VideoFile::IsLiveSource() const
+{
+	if (!videoContainer) return false;
+	//Formats without a file(e.g. rtsp) or with one that can't seek(e.g. udp, pipes).
+	if (videoContainer->iformat && (videoContainer->iformat->flags & AVFMT_NOFILE)) return true;
+	return videoContainer->pb && !(videoContainer->pb->seekable & AVIO_SEEKABLE_NORMAL);
+}
+
+void VideoFile::SelectStreams()
+{
+	//Same choice ffplay makes: most frames probed, preferring default streams.
+	videoStreamIndex = av_find_best_stream(videoContainer, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	//Cover art is stored as a one frame video stream, it isn't the video.
+	if (videoStreamIndex >= 0 && (videoContainer->streams[videoStreamIndex]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+	{
+		videoStreamIndex = -1;
+		for (unsigned int i = 0; i < videoContainer->nb_streams; i++)
 		{
-			//Loop through codecReadArr and check if any codec hasn't read it yet.
-			for (int i = 0; i < static_cast<int>(CodecType::END); i++)
+			const AVStream* stream = videoContainer->streams[i];
+			if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC))
 			{
-				//If this packet hasn't been read by a codec, then don't remove it.
-				if (iter->codecReadArr[i] == false)
-				{
-					breakLoop = true;
-					break;
-				}
+				videoStreamIndex = static_cast<int>(i);
+				break;
 			}
-			if (breakLoop) break; //This packet(and thus all following packets) has not been read by at least a codec.
-			//Packet has been read by all codecs, so remove it.
-			iter = packetArr.erase(iter);
 		}
-		return nullptr; //Not trying to get a packet.
 	}
-	//Check if any packet in the queue hasn't been read by the codec yet.
-	for (iter = packetArr.begin(); iter != packetArr.end(); iter++)
+	//Audio that goes with the video(same program), if there are several tracks.
+	audioStreamIndex = av_find_best_stream(videoContainer, AVMEDIA_TYPE_AUDIO, -1, videoStreamIndex, NULL, 0);
+	if (videoStreamIndex < 0) videoStreamIndex = -1;
+	if (audioStreamIndex < 0) audioStreamIndex = -1;
+}
+
+bool VideoFile::ReopenCodec(StreamData& streamData, int lowres)
+{
+	//lowres is only read when the codec is opened, so it needs a new context.
+	AVCodecContext* codecContext = avcodec_alloc_context3(streamData.codec);
+	if (!codecContext) return false;
+	if (avcodec_parameters_to_context(codecContext, streamData.codecParam) < 0)
 	{
-		//Check if this packet has been read by this type of codec.
-		if (iter->codecReadArr[static_cast<int>(codecType)]) continue;
-		iter->codecReadArr[static_cast<int>(codecType)] = true;
-		return &iter->packet;
+		avcodec_free_context(&codecContext);
+		return false;
 	}
-	//Add new packet here, as all packets in queue have already been read by this codec.
-	packetArr.emplace_back(); //don't use push_back, as it creates a temp copy that'll call the destructor pre-maturely.
-	//Storing data in the newly added packet.
-
-	//TODO: remove
-	//TODO: packet may sometimes be 0xcdcdcdcd instead of nullptr, so check for that too.
-	if (packetArr.back().packet == nullptr)
+	codecContext->lowres = lowres;
+	codecContext->skip_frame = streamData.codecContext->skip_frame;
+	codecContext->skip_loop_filter = streamData.codecContext->skip_loop_filter;
+	codecContext->flags2 = streamData.codecContext->flags2;
+	ConfigureThreading(codecContext, streamData);
+	if (avcodec_open2(codecContext, streamData.codec, NULL) != 0)
 	{
-		//Unable to allocate packet.
-		packetArr.pop_back(); //destroy the newly created packet data.
-		return nullptr;
+		avcodec_free_context(&codecContext);
+		return false;
 	}
-	if (av_read_frame(videoContainer, packetArr.back().packet) < 0)
+	//Frames still in the old context come before the keyframe about to be sent to the new one, so drain them instead of losing them.
+	if (avcodec_send_packet(streamData.codecContext, nullptr) == 0)
 	{
-		//Unknown error.
-		packetArr.pop_back(); //destroy the newly created packet data.
-		return nullptr;
+		while (true)
+		{
+			AVFrame* frame = av_frame_alloc();
+			if (!frame) break;
+			if (avcodec_receive_frame(streamData.codecContext, frame) != 0)
+			{
+				av_frame_free(&frame);
+				break;
+			}
+			drainedFrames.push_back(frame);
+		}
 	}
-	packetArr.back().codecReadArr[static_cast<int>(codecType)] = true;
-	//If any stream is invalid, then no need to check if that codec read the packet.
-	if (audioStreamIndex == -1) packetArr.back().codecReadArr[static_cast<int>(CodecType::AUDIOCODEC)] = true;
-	if (videoStreamIndex == -1) packetArr.back().codecReadArr[static_cast<int>(CodecType::VIDEOCODEC)] = true;
-	return &packetArr.back().packet;
+	//Frames already handed out keep their own references to the old context's buffers.
+	avcodec_free_context(&streamData.codecContext);
+	streamData.codecContext = codecContext;
+	return true;
 }
 
-void VideoFile::ClearAllPackets()
+void VideoFile::ClearDrainedFrames()
 {
-	packetArr.clear();
+	for (AVFrame*& frame : drainedFrames)
+	{
+		av_frame_free(&frame);
+	}
+	drainedFrames.clear();
 }
 
-void VideoFile::FlushAllBuffers()
+int VideoFile::GetStreamIndex(CodecType codecType) const
 {
-	//Don't flush now, only flush when codec uses all packets and needs new ones.
-	for (int i = 0; i < 5; i++)
+	switch (codecType)
 	{
-		isFlush[i] = true;
+	case CodecType::AUDIOCODEC:
+		return audioStreamIndex;
+	case CodecType::VIDEOCODEC:
+		return videoStreamIndex;
 	}
+	return -1;
 }
 
 //Returns nullptr if unable to open video file.
-AVFormatContext* GetAVFormat(const std::string& fileName)
+AVFormatContext* GetAVFormat(const std::string& fileName, const OpenConfig& openConfig)
 {
 	AVFormatContext* returnVal = avformat_alloc_context();
+	if (!returnVal) return nullptr;
+	//Also caps how much is read to detect the format, as well as avformat_find_stream_info.
+	if (openConfig.isFastOpen)
+	{
+		returnVal->probesize = openConfig.probeSize;
+		returnVal->max_analyze_duration = openConfig.analyzeDuration;
+	}
 	int err;
 	//Unable to open videofile, so set to null.
 	if ((err = avformat_open_input(&returnVal, fileName.c_str(), NULL, NULL)) != 0)
@@ -132,10 +287,13 @@ AVFormatContext* GetAVFormat(const std::string& fileName)
 	return returnVal;
 }
 
-VideoFile::VideoFile(const std::string& fileName)
+VideoFile::VideoFile(const std::string& fileName, const DemuxConfig& demuxConfig, const DecoderConfig& decoderConfig,
+	const OpenConfig& openConfig)
+	: decoderConfig{ decoderConfig }
 {
+	auto openStart = std::chrono::steady_clock::now();
 	//1. Point to the video file
-	videoContainer = GetAVFormat(fileName);
+	videoContainer = GetAVFormat(fileName, openConfig);
 	if (!videoContainer)
 	{
 		//Don't try to init an empty container, just set error and return.
@@ -144,24 +302,39 @@ VideoFile::VideoFile(const std::string& fileName)
 		return;
 	}
 
-	//2. Open video/audio streams. 
-	if (avformat_find_stream_info(videoContainer, NULL) < 0)
+	//2. Open video/audio streams. Files probed before have their stream parameters cached, so skip straight past this.
+	isProbeCached = openConfig.isProbeCacheUsed && ProbeCache::Load(fileName, videoContainer);
+	if (!isProbeCached)
 	{
-		//Don't init if cannot find streams to play.
-		errorCodes.message += "Unable to read video/audio av streams\n";
-		errorCodes.canRead = false;
-		return;
+		if (avformat_find_stream_info(videoContainer, NULL) < 0)
+		{
+			//Don't init if cannot find streams to play.
+			errorCodes.message += "Unable to read video/audio av streams\n";
+			errorCodes.canRead = false;
+			return;
+		}
+		if (openConfig.isProbeCacheUsed) ProbeCache::Save(fileName, videoContainer);
 	}
 
-	//3. Get the codec data/context for each stream.
-	//Iterate over each stream in the array and fill in streamData for streamArr.
+	probeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
+
+	//3. Pick the streams to play, only those get decoders.
+	SelectStreams();
+
+	//Iterate over each stream in the array and fill in streamData for streamArr. Indexes match the container's streams.
 	for (unsigned int i = 0; i < videoContainer->nb_streams; i++)
 	{
 		streamArr.push_back({});
 		StreamData& streamData = streamArr.back();
 		streamData.stream = videoContainer->streams[i];
-		//For each stream, find the codec param to find the codec id, and use it to find the codec, and use that to find codec context.
 		streamData.codecParam = videoContainer->streams[i]->codecpar;
+		//Not played, so the demuxer can skip its packets(often without even reading them) rather than hand them out.
+		if (static_cast<int>(i) != audioStreamIndex && static_cast<int>(i) != videoStreamIndex)
+		{
+			streamData.stream->discard = AVDISCARD_ALL;
+			continue;
+		}
+		//For each stream, find the codec param to find the codec id, and use it to find the codec, and use that to find codec context.
 		streamData.codec = avcodec_find_decoder(videoContainer->streams[i]->codecpar->codec_id);
 		//Need to alloc memory for codecContext.
 		streamData.codecContext = avcodec_alloc_context3(streamData.codec);
@@ -171,6 +344,8 @@ VideoFile::VideoFile(const std::string& fileName)
 			errorCodes.message += "Unable to open codec context for stream\n";
 			errorCodes.canCodec = false;
 		}
+		//Threading can only be set before opening.
+		ConfigureThreading(streamData.codecContext, streamData);
 		if (avcodec_open2(streamData.codecContext, streamData.codec, NULL) != 0)
 		{
 			errorCodes.message += "Unable to open codec context for stream\n";
@@ -178,20 +353,26 @@ VideoFile::VideoFile(const std::string& fileName)
 		}
 		//Just alloc memory for this, no need to update.
 		streamData.currFrame = av_frame_alloc();
+		openedDecoderCount++;
 	}
+	openSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
 
-	int index = 0;
-	for (const StreamData& streamData : streamArr)
+	//4. Start reading ahead. Only the streams that are decoded get a packet queue, packets for every other stream are thrown away when read.
+	for (AVPacket*& packet : codecPackets)
 	{
-		if (streamData.codecParam->codec_type == AVMEDIA_TYPE_AUDIO)
-		{
-			audioStreamIndex = index;
-		}
-		if (streamData.codecParam->codec_type == AVMEDIA_TYPE_VIDEO)
-		{
-			videoStreamIndex = index;
-		}
-		index++;
+		packet = av_packet_alloc();
+	}
+	std::vector<int> decodedStreams{};
+	if (audioStreamIndex != -1) decodedStreams.push_back(audioStreamIndex);
+	if (videoStreamIndex != -1) decodedStreams.push_back(videoStreamIndex);
+	demuxer = std::make_unique<Demuxer>(videoContainer, decodedStreams, demuxConfig);
+	demuxer->Start();
+
+	//5. Index keyframes in the background, for exact seeks. Local files only, it reads the whole file.
+	ProbeCache::FileStamp stamp{};
+	if (videoStreamIndex != -1 && !IsLiveSource() && ProbeCache::GetFileStamp(fileName, stamp))
+	{
+		keyframeIndex.reset(new KeyframeIndex{ fileName, videoStreamIndex });
 	}
 }
 
@@ -201,14 +382,18 @@ VideoFile::~VideoFile()
 	{
 		//Only dealloc these items, the rest is done in free_context.
 		if (streamData.codecContext) avcodec_free_context(&streamData.codecContext);
-		if (streamData.currFrame)
-		{
-			//Dereference buffer.
-			av_frame_unref(streamData.currFrame);
-			av_freep(&streamData.currFrame->data[0]);
-		}
+		//Dereferences buffer as well.
+		if (streamData.currFrame) av_frame_free(&streamData.currFrame);
+	}
+	ClearDrainedFrames();
+	//Stop the demux thread before anything it reads from is freed.
+	demuxer.reset();
+	keyframeIndex.reset();
+	for (AVPacket*& packet : codecPackets)
+	{
+		if (packet) av_packet_free(&packet);
 	}
-	if (video_resizeconvert_sws_ctxt) sws_freeContext(video_resizeconvert_sws_ctxt);
+	resizeScaler.reset();
 	if (videoContainer) avformat_close_input(&videoContainer);
 }
 
@@ -216,6 +401,8 @@ void VideoFile::PrintDetails(std::ostream& output)
 {
 	output << "Title: " << videoContainer->iformat->long_name << "\n"
 		<< "Duration: " << videoContainer->duration / AV_TIME_BASE << " secs\n"
+		<< "Opened in " << openSeconds * 1000 << " ms(" << probeSeconds * 1000 << (isProbeCached ? " ms, probe cached), " : " ms probing), ")
+		<< openedDecoderCount << " of " << streamArr.size() << " streams decoded\n"
 		<< "\n<<Stream Data>>\n";
 	for (const StreamData& streamData : streamArr)
 	{
@@ -229,13 +416,27 @@ void VideoFile::PrintDetails(std::ostream& output)
 			break;
 		}
 		output << "\nBitRate: " << streamData.codecParam->bit_rate << "\n";
+		//What the decoder actually went with, as it may not use everything it was asked for.
+		const AVCodecContext* codecContext = streamData.codecContext;
+		if (codecContext && avcodec_is_open(const_cast<AVCodecContext*>(codecContext)))
+		{
+			output << "Decoder: " << (streamData.codec ? streamData.codec->name : "none") << ", threads " << codecContext->thread_count
+				<< (codecContext->active_thread_type == FF_THREAD_FRAME ? " (frame)"
+					: codecContext->active_thread_type == FF_THREAD_SLICE ? " (slice)" : " (none)")
+				<< ((codecContext->flags & AV_CODEC_FLAG_LOW_DELAY) ? ", low delay" : "") << "\n";
+		}
 	}
 }
 
+bool VideoFile::IsError(const VideoFileError& error)
+{
+	return !error.canFind || !error.canRead || !error.canCodec || error.reachedEOF || error.resizeError;
+}
+
 const VideoFileError* VideoFile::checkIsValid()
 {
 	//There's an error.
-	if (!errorCodes.canFind || !errorCodes.canRead || !errorCodes.canCodec || errorCodes.reachedEOF || errorCodes.resizeError)
+	if (IsError(errorCodes))
 	{
 		return &errorCodes;
 	}
@@ -243,87 +444,117 @@ const VideoFileError* VideoFile::checkIsValid()
 	return nullptr;
 }
 
+const VideoFileError* VideoFile::checkIsValid(CodecType codecType)
+{
+	const VideoFileError& codecErrors = codecErrorCodes[static_cast<int>(codecType)];
+	return IsError(codecErrors) ? &codecErrors : nullptr;
+}
+
 
 void VideoFile::ResetErrorCodes()
 {
 	errorCodes = VideoFileError{};
 }
 
+void VideoFile::ResetErrorCodes(CodecType codecType)
+{
+	codecErrorCodes[static_cast<int>(codecType)] = VideoFileError{};
+}
+
 //Returns nullptr if no frame can be read, check error codes.
 AVFrame** VideoFile::GetFrame(CodecType codecType)
 {
-	int index = 0;
-	AVPacket** pPacket = nullptr;
-	switch (codecType)
-	{
-	case CodecType::AUDIOCODEC:
-		index = audioStreamIndex;
-		break;
-	case CodecType::VIDEOCODEC:
-		index = videoStreamIndex;
-		break;
-	}
+	int index = GetStreamIndex(codecType);
+	VideoFileError& codecErrors = codecErrorCodes[static_cast<int>(codecType)];
+	AVPacket* pPacket = nullptr;
+	if (index < 0) return nullptr;
 	StreamData& stream = streamArr[index];
 	int errVal{};
-	//Check if codec needs to be flushed(after seeking)
-	if (isFlush[index])
-	{
-		isFlush[index] = false;
-		avcodec_flush_buffers(stream.codecContext);
-	}
-	while ((errVal = avcodec_receive_frame(stream.codecContext, stream.currFrame)) != 0)
+	//Check if codec needs to be flushed(after seeking), so that no frames from before the seek are returned.
+	if (demuxer) CheckSerial(codecType, demuxer->GetSerial());
+	double& codecDecodeSeconds = decodeSeconds[static_cast<int>(codecType)];
+	codecDecodeSeconds = 0;
+	while (true)
 	{
+		//Drained from the context a decode reduction change replaced, so they're from before anything the new one has.
+		if (codecType == CodecType::VIDEOCODEC && !drainedFrames.empty())
+		{
+			av_frame_unref(stream.currFrame);
+			av_frame_move_ref(stream.currFrame, drainedFrames.front());
+			av_frame_free(&drainedFrames.front());
+			drainedFrames.pop_front();
+			break;
+		}
+		double callStart = Utility::GetTime();
+		errVal = avcodec_receive_frame(stream.codecContext, stream.currFrame);
+		codecDecodeSeconds += Utility::GetTime() - callStart;
+		if (errVal == 0) break;
 		//Not successful,try to resolve.
 		switch (errVal)
 		{
-			//Reached end of file, need to indicate.
+			//Reached end of file, need to indicate. Only once, as it stays that way until a seek.
 		case AVERROR_EOF:
-			errorCodes.reachedEOF = true;
-			errorCodes.message += std::to_string(index) += " stream has reached EOF\n";
+			if (!isCodecEnded[static_cast<int>(codecType)])
+			{
+				isCodecEnded[static_cast<int>(codecType)] = true;
+				codecErrors.reachedEOF = true;
+				codecErrors.message += std::to_string(index) += " stream has reached EOF\n";
+			}
+			//Nothing more until a seek, so wait for one instead of asking again straight away.
+			else if (demuxer) demuxer->WaitForSeek(codecSerials[static_cast<int>(codecType)], 100);
 			return nullptr;
 			//Send a new packet, since incomplete frame.
 		case AVERROR(EAGAIN):
 			//Read a packet and send it.
 			pPacket = GetPacket(codecType);
-			//Unknown error when getting packet, so return but don't set error codes.
-			if (!pPacket) return nullptr;
-			if ((errVal = avcodec_send_packet(stream.codecContext, *pPacket)) == 0 || errVal == AVERROR(EAGAIN))   //TODO: If exception "Access write violation" thrown here, it means the issue is with resizeVideo function when freeing originalFrame.
+			if (!pPacket)
+			{
+				//File has ended, so drain the codec of the frames it's still holding(e.g. reordered ones). It then returns AVERROR_EOF.
+				if (demuxer && demuxer->IsFinished(index) && avcodec_send_packet(stream.codecContext, nullptr) == 0) continue;
+				//No packet yet, so return but don't set error codes.
+				return nullptr;
+			}
+			//Decode reduction only changes on keyframes, so nothing decoded after refers to frames decoded the other way.
+			if (codecType == CodecType::VIDEOCODEC && (pPacket->flags & AV_PKT_FLAG_KEY)) ApplyDecodeReduction();
+			callStart = Utility::GetTime();
+			errVal = avcodec_send_packet(stream.codecContext, pPacket);
+			codecDecodeSeconds += Utility::GetTime() - callStart;
+			//Decoder keeps its own reference if needed, so the packet can be reused.
+			av_packet_unref(pPacket);
+			if (errVal == 0 || errVal == AVERROR(EAGAIN))
 			{
 				continue; //try to read a frame again.
 			}
 			else if (errVal == AVERROR_EOF)
 			{
 				//Should be caught before, but jic just set.
-				errorCodes.reachedEOF = true;
-				errorCodes.message += std::to_string(index) += " stream has reached EOF\n";
+				codecErrors.reachedEOF = true;
+				codecErrors.message += std::to_string(index) += " stream has reached EOF\n";
 				return nullptr;
 			}
 			else if (errVal == AVERROR_INVALIDDATA)
 			{
-				errorCodes.canRead = errorCodes.canCodec = false;
-				errorCodes.message += "Invalid Data reading frame from ";
-				errorCodes.message += std::to_string(index) += " stream\n";
+				codecErrors.canRead = codecErrors.canCodec = false;
+				codecErrors.message += "Invalid Data reading frame from ";
+				codecErrors.message += std::to_string(index) += " stream\n";
 				return nullptr;
 			}
 			//unable to send packet, and no frames can be read either, unable to resolve.
 			//Read error.
-			errorCodes.canRead = errorCodes.canCodec = false;
-			errorCodes.message += "Unknown error reading frame from ";
-			errorCodes.message += std::to_string(index) += " stream\n";
+			codecErrors.canRead = codecErrors.canCodec = false;
+			codecErrors.message += "Unknown error reading frame from ";
+			codecErrors.message += std::to_string(index) += " stream\n";
 			return nullptr;
 			//Unable to resolve.
 			//Read error.
 		default:
-			errorCodes.canRead = errorCodes.canCodec = false;
-			errorCodes.message += "Unknown error reading frame from ";
-			errorCodes.message += std::to_string(index) += " stream\n";
+			codecErrors.canRead = codecErrors.canCodec = false;
+			codecErrors.message += "Unknown error reading frame from ";
+			codecErrors.message += std::to_string(index) += " stream\n";
 			return nullptr;
 		}
 	}
 	//read successful.
-	//Clear all used packets(that have been read by all codecs) after avcodec_receive_frame is finished.
-	//Does not get a packet.
-	GetPacket(codecType, true);
 	return &stream.currFrame;
 }
 
@@ -367,107 +598,79 @@ int VideoFile::GetVideoStreamIndex()
 SDL_Rect VideoFile::GetVideoDimensions() const
 {
 	SDL_Rect returnVal{};
-	for (const StreamData& streamData : streamArr)
-	{
-		switch (streamData.codecParam->codec_type)
-		{
-		case AVMEDIA_TYPE_VIDEO:
-			returnVal.w = streamData.codecParam->width;
-			returnVal.h = streamData.codecParam->height;
-		}
-	}
+	//The video stream being played, not e.g. cover art.
+	if (videoStreamIndex < 0) return returnVal;
+	returnVal.w = streamArr[videoStreamIndex].codecParam->width;
+	returnVal.h = streamArr[videoStreamIndex].codecParam->height;
 	return returnVal;
 }
 
 /*
 	1. Allocates an sws_context(ffmpeg) if none found/a new one is needed.
-	2. Allocates a temp frame and fills it with required memory.
-	3.
+	2. Allocates buffers for resizedFrame with the new format and dimensions.
+	3. Converts originalFrame into resizedFrame.
 */
-void VideoFile::ResizeVideoFrame(AVFrame*& originalFrame, int width, int height)
+bool VideoFile::ResizeVideoFrame(const AVFrame* originalFrame, AVFrame* resizedFrame, int width, int height, int flags)
 {
-	if (!originalFrame) return;
-	//Store original presentation time, so that it can be changed when reassigning frames.
-	int64_t originalPts = originalFrame->pts;
-	int64_t originalDts = originalFrame->pkt_dts;
-	//Checks if a new context needs to be allocated.
-	static int prevWidth{}, prevHeight{};
+	if (!originalFrame || !resizedFrame) return false;
+	//Only called from the video decode thread.
+	VideoFileError& videoErrors = codecErrorCodes[static_cast<int>(CodecType::VIDEOCODEC)];
 
 	int videoStreamIndex = GetVideoStreamIndex();
 	if (videoStreamIndex < 0) //No video stream found
 	{
-		errorCodes.resizeError = true;
-		errorCodes.message += "No video stream found\n";
-		return;
+		videoErrors.resizeError = true;
+		videoErrors.message += "No video stream found\n";
+		return false;
 	}
-	StreamData& videoStreamData = streamArr[videoStreamIndex];
 
-	//Need to reallocate context, either dimensions changed or it's a new video file(i.e. none allocated yet).
-	if (prevWidth != width || prevHeight != height || video_resizeconvert_sws_ctxt == nullptr)
+	//Band contexts are only rebuilt if the input or output changed, e.g. it's a new video file or the window was resized.
+	if (!resizeScaler) resizeScaler.reset(new SliceScaler{});
+	if (!resizeScaler->Configure(
+		originalFrame->width, originalFrame->height, static_cast<AVPixelFormat>(originalFrame->format),
+		width, height, AV_PIX_FMT_YUV420P, //Change to new height and YUV420P format(standardised to follow sdl display)
+		flags))
 	{
-		if (video_resizeconvert_sws_ctxt) sws_freeContext(video_resizeconvert_sws_ctxt);
-		video_resizeconvert_sws_ctxt = sws_getContext(
-			videoStreamData.codecContext->width, videoStreamData.codecContext->height, videoStreamData.codecContext->pix_fmt,
-			width, height, AV_PIX_FMT_YUV420P, //Change to new height and YUV420P format(standardised to follow sdl display)
-			SWS_BICUBIC, //better quality than billinear
-			NULL,
-			NULL,
-			NULL);
-		prevWidth = width;
-		prevHeight = height;
-		if (!video_resizeconvert_sws_ctxt)
-		{
-			errorCodes.resizeError = true;
-			errorCodes.message += "Unable to set sws_context for resizing+converting video\n";
-			return;
-		}
+		videoErrors.resizeError = true;
+		videoErrors.message += "Unable to set sws_context for resizing+converting video\n";
+		return false;
 	}
 
-	//Allocates a new frame with new format and dimensions.
-	//Used as return value.
-	AVFrame* tempFrame = av_frame_alloc();
-	if (!tempFrame)
+	//Reuses resizedFrame's buffers from last time if they fit, so steady playback doesn't allocate.
+	bool isBufferReusable = resizedFrame->buf[0] && av_frame_is_writable(resizedFrame)
+		&& resizedFrame->format == AV_PIX_FMT_YUV420P && resizedFrame->width == width && resizedFrame->height == height;
+	if (!isBufferReusable)
 	{
-		errorCodes.resizeError = true;
-		errorCodes.message += "Unable to allocate temporary frame for resize\n";
-		return;
+		av_frame_unref(resizedFrame);
+		resizedFrame->format = AV_PIX_FMT_YUV420P;
+		resizedFrame->width = width;
+		resizedFrame->height = height;
+		if (av_frame_get_buffer(resizedFrame, resizeBufferAlignment) < 0)
+		{
+			videoErrors.resizeError = true;
+			videoErrors.message += "Error allocating frame\n";
+			return false;
+		}
+		resizeAllocationCount++;
 	}
-	int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 1);
-	uint8_t* frame2_buffer = (uint8_t*)av_malloc(num_bytes);
-	//"Fills" the temp frame with rest of the required memory(av_frame_alloc only does the basic memory alloc).
-	if (num_bytes < 0 || !frame2_buffer || av_image_fill_arrays(tempFrame->data, tempFrame->linesize, (uint8_t*)frame2_buffer, AV_PIX_FMT_YUV420P, width, height, 1) < 0)
+
+	//Converts frame into correct format and dimensions, then puts it into resizedFrame. Bands are scaled in parallel.
+	if (!resizeScaler->Scale(originalFrame, resizedFrame))
 	{
-		//Error occured. Note that the rest won't run if prior conditions fulfilled, due to short-circuiting.
-		errorCodes.resizeError = true;
-		errorCodes.message += "Error allocating frame\n";
-		void* buffer_ptr = &originalFrame->data[0];
-		av_frame_unref(tempFrame);
-		//if(buffer_ptr) av_free(buffer_ptr);
-		av_frame_free(&tempFrame);
-		return;
+		videoErrors.resizeError = true;
+		videoErrors.message += "Unable to resize video frame\n";
+		return false;
 	}
-
-
-
-	//Converts frame into correct format and dimensions, then puts it into tempFrame. 
-	sws_scale(video_resizeconvert_sws_ctxt, originalFrame->data, originalFrame->linesize, 0, originalFrame->height, tempFrame->data, tempFrame->linesize);
-
-	//Throw away the old frame and get the new frame.
-	//Dereference buffers before freeing, necessary otherwise there'll be heap corruption.
-	void* buffer_ptr = &originalFrame->data[0];
-	av_frame_unref(originalFrame);
-	//if(buffer_ptr) av_free(buffer_ptr); //Commenting both out will run the video player no issues.
-	av_frame_free(&originalFrame);
-
-	//Saves the buffer that the previous frame was using(i.e. originalFrame's buffer) and frees it here.
-	static void* prev_buffer = nullptr;
-	if (prev_buffer) av_freep(&prev_buffer);
-	prev_buffer = frame2_buffer;
-
-	originalFrame = tempFrame;
-	originalFrame->pts = originalPts; //So that the new frame will have the old frame's time.
-	originalFrame->pkt_dts = originalDts;
-
+	//So that the new frame will have the old frame's time.
+	//Only the timing fields, as av_frame_copy_props also copies side data and metadata, which allocates.
+	resizedFrame->pts = originalFrame->pts;
+	resizedFrame->pkt_dts = originalFrame->pkt_dts;
+	resizedFrame->best_effort_timestamp = originalFrame->best_effort_timestamp;
+	resizedFrame->pkt_duration = originalFrame->pkt_duration;
+	resizedFrame->key_frame = originalFrame->key_frame;
+	resizedFrame->pict_type = originalFrame->pict_type;
+	resizedFrame->sample_aspect_ratio = originalFrame->sample_aspect_ratio;
+	return true;
 }
 
 StreamData VideoFile::GetStreamData(int stream_index)
@@ -7,9 +7,14 @@
 #ifndef FFMPEG_VIDEOFILEFUNCTIONS_HPP
 #define FFMPEG_VIDEOFILEFUNCTIONS_HPP
 #include "types.hpp"
+#include "Demuxer.hpp"
+#include "SliceScaler.hpp"
+#include "KeyframeIndex.hpp"
 #include <string>
 #include <vector>
-#include <list>
+#include <deque>
+#include <memory>
+#include <atomic>
 
 enum class CodecType
 {
@@ -18,25 +23,6 @@ enum class CodecType
 	END, //Used for size of array
 };
 
-// Packet queue.
-// When a packet is sent to all codecs, it can be removed from the queue.
-// Only add another packet to the queue if packets within the queue are already read by the codec.
-class PacketData
-{
-public:
-	PacketData();
-	~PacketData();
-
-	PacketData(const PacketData& toCopy) = delete;
-	PacketData& operator=(const PacketData& rhs) = delete;
-
-	AVPacket* packet = nullptr; //Need to alloc and dealloc.
-	//May be replaced by a single int and using bitwise | and & to check and add values.
-	bool codecReadArr[static_cast<int>(CodecType::END)]{}; //Default is false
-};
-
-
-
 //Relevant attributes for each individual stream. 
 struct StreamData
 {
@@ -48,6 +34,46 @@ struct StreamData
 	AVFrame* currFrame{}; //Need to alloc.
 };
 
+//How a decoder splits its work across threads.
+enum class DecoderThreading
+{
+	AUTO = 0, //Frame threading if the codec has it, else slice threading. Slice threading if low delay.
+	FRAME, //Decodes several frames at once. Most throughput, but frames come out thread count frames later.
+	SLICE, //Decodes parts of one frame at once. No extra delay, but only helps if the stream has several slices per frame.
+	NONE,
+};
+
+//Threading policy for one kind of stream, used when its decoder is opened.
+struct DecoderThreadConfig
+{
+	DecoderThreading threading = DecoderThreading::AUTO;
+	//0 --> Chosen from the resolution and number of cores.
+	int threadCount = 0;
+	//Frames come out as soon as they're decoded, no frame threading or reordering delay. For live sources.
+	bool isLowDelay = false;
+	//Turns on isLowDelay for sources that can't seek, e.g. network streams.
+	bool isLowDelayWhenLive = true;
+};
+
+struct DecoderConfig
+{
+	DecoderThreadConfig video{};
+	//Audio decoders are cheap, and most have no threading.
+	DecoderThreadConfig audio{ DecoderThreading::NONE, 1, false, false };
+};
+
+//How much work opening a file does before the first frame.
+struct OpenConfig
+{
+	//Caps probing to probeSize/analyzeDuration, instead of ffmpeg's defaults(5MB, and up to several seconds of every stream decoded).
+	bool isFastOpen = false;
+	int64_t probeSize = 512 * 1024;
+	//In AV_TIME_BASE.
+	int64_t analyzeDuration = AV_TIME_BASE / 2;
+	//Skips probing for files probed before, using the sidecar ProbeCache keeps. Written after probing if there isn't one.
+	bool isProbeCacheUsed = true;
+};
+
 struct VideoFileError
 {
 	bool canFind = true;
@@ -61,7 +87,8 @@ struct VideoFileError
 class VideoFile
 {
 public:
-	VideoFile(const std::string& fileName);
+	VideoFile(const std::string& fileName, const DemuxConfig& demuxConfig = DemuxConfig{}, const DecoderConfig& decoderConfig = DecoderConfig{},
+		const OpenConfig& openConfig = OpenConfig{});
 	~VideoFile();
 
 	//Copy ctor/operator is deleted for now, as unable to control underlying details about ffmpeg.
@@ -71,13 +98,21 @@ public:
 	VideoFile(const VideoFile& donor) = delete;
 	VideoFile& operator=(const VideoFile& rhs) = delete;
 
+	//Prints the container and each stream's details, and how long opening the file took.
 	void PrintDetails(std::ostream& output);
+	//Seconds the constructor took to open the file and its decoders.
+	double GetOpenSeconds() const { return openSeconds; }
+	//True if stream parameters came from the probe cache, rather than probing.
+	bool IsProbeCached() const { return isProbeCached; }
 
 	//Returns pointer to video file's error code if there's an error, else returns nullptr.
 	const VideoFileError *checkIsValid();
+	//Same, for errors decoding with that codec(and resizing, for the video codec). Only call from the thread decoding it.
+	const VideoFileError* checkIsValid(CodecType codecType);
 	
 	//Call once errors are handled, to reset errors.
 	void ResetErrorCodes();
+	void ResetErrorCodes(CodecType codecType);
 
 	/*
 	Gets an AvFrame for that particular stream.
@@ -102,57 +137,175 @@ public:
 	SDL_Rect GetVideoDimensions() const;
 
 	/*
-	Will destroy the old frame, leaving the new frame in its place.
+	Converts originalFrame to YUV420P at the given dimensions, and stores it in resizedFrame.
+	flags --> sws flags to scale with, e.g. SWS_BILINEAR to scale faster at lower quality.
+	originalFrame is left untouched, so it stays owned by the decoder.
+	resizedFrame's buffers are reused if they already fit the output, so pass in the same frames every time(e.g. from a FrameQueue).
+	New(aligned) buffers are only allocated when the output dimensions change.
+	Returns false if unable to, check error codes.
 	*/
-	void ResizeVideoFrame(AVFrame*& originalFrame, int width, int height);
+	bool ResizeVideoFrame(const AVFrame* originalFrame, AVFrame* resizedFrame, int width, int height, int flags = SWS_BICUBIC);
+
+	//Number of times ResizeVideoFrame had to allocate buffers. Stays the same during steady playback.
+	int GetResizeAllocationCount() const { return resizeAllocationCount; }
+
+	//Byte alignment of the buffers ResizeVideoFrame allocates, wide enough for SIMD loads/stores.
+	static const int resizeBufferAlignment = 64;
 	
 
 	/*
-		Gets a packet from the queue for that codec.
-		When all codecs read the packet, it is removed.
-		Packets are read from the queue first, if all packets are already read by that codec, then a new one is read from the container and added to the queue.
+		Gets the next packet for that codec, from its stream's packet queue (filled by the demux thread).
+		Waits briefly if the queue is empty, returns nullptr if none arrives.
+		Flushes the codec's buffers if the packet is from after a seek.
+		The packet is owned by VideoFile and is only valid until the next GetPacket call for that codec.
 	*/
-	AVPacket** GetPacket(CodecType codec, bool isClearPackets = false);
+	AVPacket* GetPacket(CodecType codec);
 
 	/*
-		Clear all packets from queue, read or unread.
+		Seeks every stream to the given time. Done asynchronously by the demux thread,
+		codecs are flushed once they get to the packets from the new position.
+		Lands on the keyframe at or before the time(straight from the keyframe index once it's built),
+		decoders then throw away frames before the time(see GetSeekTarget), so playback starts exactly there.
+		Returns the serial frames from after the seek will have, -1 if unable to seek.
 	*/
-	void ClearAllPackets();
+	int Seek(double seconds);
+	//Seconds of the seek the codec's current packets are from, -1 if none. Frames ending before this should be thrown away.
+	double GetSeekTarget(CodecType codecType);
+	//Prints the keyframe index's stats, if there is one.
+	void PrintKeyframeIndexStats(std::ostream& output);
+	//Null if there's no index, e.g. live sources. Find can be called from any thread while it builds.
+	const KeyframeIndex* GetKeyframeIndex() const { return keyframeIndex.get(); }
+
+	//Prints depth, peak depth and how often each stream's packet queue was full.
+	void PrintPacketQueueStats(std::ostream& output);
+
+	void SetDemuxConfig(const DemuxConfig& demuxConfig);
+
+	//Seek serial of the packets currently being read. Frames decoded under an older serial are from before a seek.
+	int GetSerial() const { return demuxer ? demuxer->GetSerial() : 0; }
+	//Seek serial of the last packet sent to that codec.
+	int GetCodecSerial(CodecType codecType) const { return codecSerials[static_cast<int>(codecType)]; }
+	//True once that codec has given every frame up to the end of the file, until the next seek. Only call from the thread decoding it.
+	bool IsEnded(CodecType codecType) const { return isCodecEnded[static_cast<int>(codecType)]; }
+	//Seconds the last GetFrame for that codec spent decoding, leaving out waiting for packets or a seek. Only call from the thread decoding it.
+	double GetDecodeSeconds(CodecType codecType) const { return decodeSeconds[static_cast<int>(codecType)]; }
 
 	/*
-		Flush codec buffers
+		Sets which frames that codec skips decoding, e.g. AVDISCARD_NONREF to skip frames nothing else refers to.
+		Only call from the thread decoding that codec.
 	*/
-	void FlushAllBuffers();
+	void SetSkipFrame(CodecType codecType, AVDiscard discard);
+
+	/*
+		Size the video is shown at, so decoding can be cheaper when that's much smaller than the video.
+		Once it's at most half the video's size, the video codec decodes at a reduced resolution(lowres, 1/2 to 1/8) if it supports that,
+		or otherwise skips the loop filter and uses its fast(less accurate) paths. Goes back to full decoding once it's bigger again.
+		Changes apply at the next keyframe, so no frames reference ones decoded the other way. 0 for either to always decode fully.
+		Safe to call from any thread.
+	*/
+	void SetTargetDimensions(int width, int height);
+	/*
+		Lower limits on how much the video codec cuts, whatever the target dimensions, e.g. to keep up on slow machines.
+		minReduction --> log2 of the least the decode resolution is reduced by, or fast decoding if the codec has no lowres.
+		isSkipLoopFilter --> Skip the loop filter(deblocking) even when decoding at full resolution.
+		Applied at the next keyframe like SetTargetDimensions. Safe to call from any thread.
+	*/
+	void SetMinDecodeReduction(int minReduction, bool isSkipLoopFilter);
+	//log2 of how much the video codec is shrinking frames, e.g. 1 for half width and height. Frames come out that size.
+	int GetLowres() const { return videoLowres; }
+	//Whether the video codec is using fast paths(and skipping the loop filter), for codecs without lowres.
+	bool IsFastDecode() const { return isVideoFastDecode; }
 
 	/*
 		Returns stream data.
 	*/
 	StreamData GetStreamData(int stream_index);
 
-	AVFormatContext* GetFormatContext() { return videoContainer; }
-
 private:
 	AVFormatContext* videoContainer = nullptr;
 	std::vector<StreamData> streamArr{}; //Need to dealloc codecContext.
-	
-// Packet queue.
-// When a packet is sent to all codecs, it can be removed from the queue.
-// Only add another packet to the queue if packets within the queue are already read by the codec.
-	std::list<PacketData> packetArr{}; //Will alloc and dealloc itself.
 
-	//Used to resize and convert video using sws_scale.
-	//Allocated and deallocated when used.
-	struct SwsContext* video_resizeconvert_sws_ctxt = nullptr; 
+	//Returns the stream index decoded by that codec, -1 if none.
+	int GetStreamIndex(CodecType codecType) const;
+
+	//Flushes the codec's buffers if the demuxer has seeked since the codec last got a packet.
+	void CheckSerial(CodecType codecType, int serial);
+
+	//Switches the video codec to the reduction wanted for the target dimensions, if it isn't already. Call right before sending a keyframe.
+	void ApplyDecodeReduction();
+	/*
+		Sets the threading the context is opened with, from decoderConfig for the stream's type.
+		Thread count scales with resolution(more pixels, more to split up), capped by the number of cores.
+	*/
+	void ConfigureThreading(AVCodecContext* codecContext, const StreamData& streamData) const;
+	//Picks the video and audio streams to play(sets videoStreamIndex/audioStreamIndex), -1 for none.
+	void SelectStreams();
+	//True if the source can't seek, e.g. a live network stream.
+	bool IsLiveSource() const;
+
+	/*
+		Replaces the codec's context with one opened at that lowres. Returns false if unable to.
+		Frames still buffered in the old one(e.g. one per frame thread) are drained into drainedFrames, GetFrame returns them first.
+	*/
+	bool ReopenCodec(StreamData& streamData, int lowres);
+	//Frames drained from the video context ReopenCodec replaced, oldest first. Need to dealloc. Dropped on a seek.
+	std::deque<AVFrame*> drainedFrames{};
+	void ClearDrainedFrames();
+
+	//Keyframes of the video stream, built in the background. Only for local files, as it reads the whole file.
+	std::unique_ptr<KeyframeIndex> keyframeIndex{};
+
+	//Threading policy each decoder is opened with, kept so reopened decoders use it as well.
+	DecoderConfig decoderConfig{};
+	//Most threads chosen automatically. More than this rarely helps, and frame threading adds a frame of delay per thread.
+	static const int maxAutoThreads = 16;
+
+	//Reads packets into a queue for each decoded stream, on its own thread. Owns reading from videoContainer.
+	std::unique_ptr<Demuxer> demuxer{};
+	//Packet handed out by GetPacket for each codec, indexed by CodecType. Need to alloc and dealloc.
+	AVPacket* codecPackets[static_cast<int>(CodecType::END)]{};
+	//Seek serial each codec is decoding, indexed by CodecType.
+	int codecSerials[static_cast<int>(CodecType::END)]{};
+	//Set once that codec has given its last frame, until the next seek. Indexed by CodecType.
+	bool isCodecEnded[static_cast<int>(CodecType::END)]{};
+	//Time the last GetFrame spent in avcodec_send_packet/avcodec_receive_frame, indexed by CodecType.
+	double decodeSeconds[static_cast<int>(CodecType::END)]{};
+
+	//Size the video is shown at, set by SetTargetDimensions. 0 to always decode fully.
+	std::atomic<int> targetWidth{ 0 }, targetHeight{ 0 };
+	//Set by SetMinDecodeReduction.
+	std::atomic<int> minDecodeReduction{ 0 };
+	std::atomic<bool> isSkipLoopFilterRequested{ false };
+	//Reduction the video codec is decoding with. Only changed on the video decode thread.
+	std::atomic<int> videoLowres{ 0 };
+	std::atomic<bool> isVideoFastDecode{ false };
+	std::atomic<bool> isVideoLoopFilterSkipped{ false };
+	//Most the decode resolution is reduced by, 1/8.
+	static const int maxDecodeReduction = 3;
+
+	//Used to resize and convert video using sws_scale, split into bands scaled on multiple threads.
+	//Created the first time a frame needs resizing.
+	std::unique_ptr<SliceScaler> resizeScaler{};
+	int resizeAllocationCount = 0;
 
 	//Error code. Used instead of std::exceptions(which can crash the program if not caught).
 	VideoFileError errorCodes{};
+	//Errors from each codec's decode thread, indexed by CodecType. Kept apart so the threads never touch each other's.
+	VideoFileError codecErrorCodes[static_cast<int>(CodecType::END)]{};
+	static bool IsError(const VideoFileError& error);
 
 	int audioStreamIndex = -1;
 	int videoStreamIndex = -1;
+
+	//Time taken by the constructor, in seconds. Probing is opening the file and finding stream info, the rest is opening decoders.
+	double openSeconds = 0;
+	double probeSeconds = 0;
+	int openedDecoderCount = 0;
+	bool isProbeCached = false;
 };
 
 
 
-//Returns nullptr if unable to open video file.
-AVFormatContext* GetAVFormat(const std::string &fileName);
+//Returns nullptr if unable to open video file. Probing is capped if openConfig.isFastOpen.
+AVFormatContext* GetAVFormat(const std::string &fileName, const OpenConfig& openConfig = OpenConfig{});
 #endif
\ No newline at end of file
@@ -10,7 +10,9 @@
 #include "Display.hpp"
 #include "shobjidl_core.h"
 #include "Windows.hpp"
+#include "Benchmark.hpp"
 #include <iostream>
+#include <cstdlib>
 
 /*-----------------------
 Functions*/
@@ -19,10 +21,13 @@ void Update();
 void Draw();
 void FreeSystem();
 void Input();
+void HandleEvent(const SDL_Event& sdl_event, bool& quit);
 
 /*----------------------
 * Global varables*/
 bool isPaused = false;
+//How long to sleep waiting for input while paused.
+const int paused_wait_ms = 250;
 
 /*
 	Entry point of the program.
@@ -30,6 +35,42 @@ bool isPaused = false;
 */
 int main(int argc, char** argv)
 {
+	//Benchmark mode, e.g. "VideoPlayer.exe --benchmark". Runs without a window or video file. Exits with 1 if a check fails.
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string{ argv[i] } == "--benchmark")
+		{
+			return Benchmark::RunAll(std::cout) ? 0 : 1;
+		}
+		//Reverse playback of each file given after it, e.g. "--benchmark-reverse 1080p.mp4 2160p.mp4".
+		if (std::string{ argv[i] } == "--benchmark-reverse")
+		{
+			for (i++; i < argc; i++) Benchmark::RunReverse(argv[i], std::cout);
+			return 0;
+		}
+		//Converts/scales frames straight into locked textures instead of into their own buffers first.
+		if (std::string{ argv[i] } == "--lock-upload") DisplayWindow::SetUploadMode(UploadMode::LOCK);
+		//Video decoder threading, e.g. "--decode-threads 4 --slice-threads" to trade throughput for latency.
+		DecoderConfig decoder_config = VideoPlayer::GetDecoderConfig();
+		if (std::string{ argv[i] } == "--frame-threads") decoder_config.video.threading = DecoderThreading::FRAME;
+		if (std::string{ argv[i] } == "--slice-threads") decoder_config.video.threading = DecoderThreading::SLICE;
+		if (std::string{ argv[i] } == "--no-decode-threads") decoder_config.video.threading = DecoderThreading::NONE;
+		if (std::string{ argv[i] } == "--low-delay") decoder_config.video.isLowDelay = true;
+		if (std::string{ argv[i] } == "--decode-threads" && i + 1 < argc) decoder_config.video.threadCount = std::atoi(argv[++i]);
+		VideoPlayer::SetDecoderConfig(decoder_config);
+		//Caps probing when opening files, and/or stops using the probe cache sidecars.
+		OpenConfig open_config = VideoPlayer::GetOpenConfig();
+		if (std::string{ argv[i] } == "--fast-open") open_config.isFastOpen = true;
+		if (std::string{ argv[i] } == "--no-probe-cache") open_config.isProbeCacheUsed = false;
+		VideoPlayer::SetOpenConfig(open_config);
+		//Memory kept for stepping and seeking back over decoded frames, e.g. "--frame-cache-mb 0" to disable.
+		if (std::string{ argv[i] } == "--frame-cache-mb" && i + 1 < argc) VideoPlayer::SetFrameCacheBudget(std::atoll(argv[++i]) * 1024 * 1024);
+		//Reverse playback's worker count and chunk size, e.g. "--reverse-workers 4 --reverse-chunk-mb 128".
+		ReverseConfig reverse_config = VideoPlayer::GetReverseConfig();
+		if (std::string{ argv[i] } == "--reverse-workers" && i + 1 < argc) reverse_config.workerCount = std::atoi(argv[++i]);
+		if (std::string{ argv[i] } == "--reverse-chunk-mb" && i + 1 < argc) reverse_config.chunkBytes = std::atoll(argv[++i]) * 1024 * 1024;
+		VideoPlayer::SetReverseConfig(reverse_config);
+	}
 	//Temp error code to indicate unable to initialize system.
 	if (!InitializeSystem()) return 10;
 	//While program is running
@@ -56,14 +97,23 @@ int main(int argc, char** argv)
 		//While video is running
 		while (VideoPlayer::isRun_Video && !quit)
 		{
+			//Sleep until the next frame is due or there's input, instead of spinning.
+			//A seek while paused(e.g. a frame step) still needs its frame drawn.
+			int wait_ms = isPaused && !VideoPlayer::isSeekHolding ? paused_wait_ms : VideoPlayer::GetMillisecondsToNextFrame();
+			if (SDL_WaitEventTimeout(&sdl_event, wait_ms)) HandleEvent(sdl_event, quit);
 			Utility::UpdateDeltaTime();
 			Input();
 			//Closing window will cause both inner and outer loops to break after appropriate freeing of resources.
 			while (SDL_PollEvent(&sdl_event))
 			{
-				if (sdl_event.type == SDL_QUIT) quit = true;
+				HandleEvent(sdl_event, quit);
+			}
+			if (isPaused)
+			{
+				//Don't continue updating or drawing, other than to show where a seek landed.
+				if (VideoPlayer::isSeekHolding) Draw();
+				continue;
 			}
-			if (isPaused) continue; //Don't continue updating or drawing.
 			Update();
 			Draw();
 		}
@@ -96,6 +146,15 @@ void FreeSystem()
 	DisplayWindow::Free();
 }
 
+void HandleEvent(const SDL_Event& sdl_event, bool& quit)
+{
+	if (sdl_event.type == SDL_QUIT) quit = true;
+	//Frames are only presented when a new one is due, so present the last one again if the window needs repainting.
+	if (sdl_event.type == SDL_WINDOWEVENT && sdl_event.window.event == SDL_WINDOWEVENT_EXPOSED) VideoPlayer::Redraw();
+	//Also sent when going in/out of fullscreen.
+	if (sdl_event.type == SDL_WINDOWEVENT && sdl_event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) VideoPlayer::HandleWindowResize();
+}
+
 void Input()
 {
 	static float input_delay = 0;
@@ -109,14 +168,8 @@ void Input()
 			input_delay = 0.2f;
 			isPaused = !isPaused;
 			std::cout << "paused/unpaused\n";
-			if (isPaused)
-			{
-				if (VideoPlayer::audio_device != 0) SDL_PauseAudioDevice(VideoPlayer::audio_device, 1);
-			}
-			else
-			{
-				if (VideoPlayer::audio_device != 0) SDL_PauseAudioDevice(VideoPlayer::audio_device, 0);
-			}
+			//Stops the audio device and the clocks, so the video time doesn't run on while paused.
+			VideoPlayer::SetPaused(isPaused);
 		}
 
 		//Seek right by 10s.
@@ -131,6 +184,29 @@ void Input()
 			input_delay = 0.2f;
 			VideoPlayer::SeekVideo(-10.0);
 		}
+		//Step a single frame forward/back, pausing if playing.
+		if (keyboard[SDL_SCANCODE_PERIOD] || keyboard[SDL_SCANCODE_COMMA])
+		{
+			input_delay = 0.1f;
+			isPaused = true;
+			VideoPlayer::StepFrame(keyboard[SDL_SCANCODE_PERIOD] ? 1 : -1);
+		}
+		//Play in reverse, each press doubles the speed up to 4x, then plays forwards again.
+		if (keyboard[SDL_SCANCODE_R])
+		{
+			input_delay = 0.2f;
+			double reverse_speed = VideoPlayer::GetReverseSpeed();
+			reverse_speed = reverse_speed <= 0 ? 1 : (reverse_speed < 4 ? reverse_speed * 2 : 0);
+			isPaused = false;
+			VideoPlayer::SetPaused(false);
+			VideoPlayer::SetReverse(reverse_speed);
+			std::cout << "reverse speed " << reverse_speed << "x\n";
+		}
+		if (keyboard[SDL_SCANCODE_F])
+		{
+			input_delay = 0.2f;
+			DisplayWindow::ToggleFullscreen();
+		}
 	}
 	input_delay -= static_cast<float>(Utility::deltaTime);
 }
\ No newline at end of file
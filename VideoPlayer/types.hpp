@@ -17,6 +17,7 @@ extern "C" //Required for compatibility with c++.
 	#include <libavformat/avformat.h>
 	#include <libavutil/dict.h>
 	#include <libavutil/imgutils.h>
+	#include <libavutil/cpu.h>
 	#include <libavcodec/avcodec.h>
 	#include <libswresample/swresample.h>
 }